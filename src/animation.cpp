@@ -0,0 +1,471 @@
+#include "animation.h"
+#include "mandelbrot.h"
+#include "png_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+/* Levels are rendered this many times the frame size each way, so a level
+ * serves every frame from its own zoom down to this many times deeper */
+constexpr unsigned int LEVEL_SCALE = 2;
+
+/* A run of consecutive frames resampled from one rendered view */
+struct Level {
+  Keyframe view;
+  size_t first;
+  size_t last;
+};
+
+/* The result of encoding a frame: PNGs are written out straight away, while
+ * y4m frames are returned to be appended to the stream in order */
+struct EncodedFrame {
+  bool ok{true};
+  std::vector<unsigned char> bytes;
+};
+
+bool endsWith(std::string const &text, std::string const &suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<Keyframe> interpolate(std::vector<Keyframe> const &keyframes,
+                                  unsigned int frames_per_key) {
+  std::vector<Keyframe> frames;
+
+  for (size_t k = 0; k + 1 < keyframes.size(); k++) {
+    Keyframe const &from = keyframes[k];
+    Keyframe const &to = keyframes[k + 1];
+
+    for (unsigned int f = 0; f < frames_per_key; f++) {
+      double t = (double)f / frames_per_key;
+      Keyframe frame;
+      // Geometric in zoom, so the video zooms in at a steady rate
+      frame.zoom = from.zoom * std::pow(to.zoom / from.zoom, t);
+      // The center moves in step with the zoom, so that the whole segment
+      // zooms in on one fixed point rather than panning across the picture
+      double s = from.zoom == to.zoom
+                     ? t
+                     : (from.zoom - frame.zoom) / (from.zoom - to.zoom);
+      frame.center_x = from.center_x + (to.center_x - from.center_x) * s;
+      frame.center_y = from.center_y + (to.center_y - from.center_y) * s;
+      frame.max_iterations = std::lround(
+          from.max_iterations +
+          ((double)to.max_iterations - from.max_iterations) * t);
+      frames.push_back(frame);
+    }
+  }
+  frames.push_back(keyframes.back());
+
+  return frames;
+}
+
+/* Whether frame can be resampled from a level rendered at view */
+bool covers(Keyframe const &view, Keyframe const &frame, double x_range,
+            double y_range) {
+  if (frame.zoom > view.zoom || frame.zoom * LEVEL_SCALE < view.zoom) {
+    return false;
+  }
+
+  // Allow for rounding in the centers of frames on the edge of the view
+  double slack = 1.0 + 1e-9;
+  double dx = std::abs((frame.center_x - view.center_x).toDouble());
+  double dy = std::abs((frame.center_y - view.center_y).toDouble());
+  return (dx * 2.0 + frame.zoom * x_range) <= view.zoom * x_range * slack &&
+         (dy * 2.0 + frame.zoom * y_range) <= view.zoom * y_range * slack;
+}
+
+/* Groups consecutive frames into levels. Each level is rendered at the
+ * widest of its frames, which must contain the others and be no more than
+ * LEVEL_SCALE times wider than any of them; this works for zooming out as
+ * well as in. */
+std::vector<Level> planLevels(std::vector<Keyframe> const &frames,
+                              double x_range, double y_range) {
+  std::vector<Level> levels;
+
+  for (size_t f = 0; f < frames.size(); f++) {
+    if (!levels.empty()) {
+      Level candidate = levels.back();
+      if (frames[f].zoom > candidate.view.zoom) {
+        unsigned int iterations = candidate.view.max_iterations;
+        candidate.view = frames[f];
+        candidate.view.max_iterations = iterations;
+      }
+      candidate.view.max_iterations =
+          std::max(candidate.view.max_iterations, frames[f].max_iterations);
+      candidate.last = f + 1;
+
+      bool fits = true;
+      for (size_t g = candidate.first; g <= f && fits; g++) {
+        fits = covers(candidate.view, frames[g], x_range, y_range);
+      }
+      if (fits) {
+        levels.back() = candidate;
+        continue;
+      }
+    }
+
+    levels.push_back(Level{frames[f], f, f + 1});
+  }
+
+  return levels;
+}
+
+Uint32 channel(Uint32 pixel, unsigned int shift) {
+  return (pixel >> shift) & 0xff;
+}
+
+/* Bilinearly resamples the frame at frame out of the level image, which is
+ * LEVEL_SCALE times the frame size. Pixel i of a frame lies at
+ * x_min + i * dx, as in Mandelbrot, so this maps the frame's pixels onto
+ * the level's and interpolates between the four nearest. */
+void resample(std::vector<Uint32> const &level_pixels, Keyframe const &view,
+              Keyframe const &frame, unsigned int width, unsigned int height,
+              double x_range, double y_range, std::vector<Uint32> &pixels) {
+  unsigned int level_width = width * LEVEL_SCALE;
+  unsigned int level_height = height * LEVEL_SCALE;
+
+  // The frame's size and offset in fractions of the level's view
+  double scale = frame.zoom / view.zoom;
+  double offset_x =
+      (frame.center_x - view.center_x).toDouble() / (view.zoom * x_range);
+  double offset_y =
+      (frame.center_y - view.center_y).toDouble() / (view.zoom * y_range);
+
+  for (unsigned int j = 0; j < height; j++) {
+    double v = (offset_y + 0.5 + scale * ((double)j / height - 0.5)) *
+               level_height;
+    v = std::min(std::max(v, 0.0), (double)(level_height - 1));
+    unsigned int v0 = (unsigned int)v;
+    unsigned int v1 = std::min(v0 + 1, level_height - 1);
+    double fy = v - v0;
+
+    Uint32 const *top = &level_pixels[(size_t)v0 * level_width];
+    Uint32 const *bottom = &level_pixels[(size_t)v1 * level_width];
+
+    for (unsigned int i = 0; i < width; i++) {
+      double u = (offset_x + 0.5 + scale * ((double)i / width - 0.5)) *
+                 level_width;
+      u = std::min(std::max(u, 0.0), (double)(level_width - 1));
+      unsigned int u0 = (unsigned int)u;
+      unsigned int u1 = std::min(u0 + 1, level_width - 1);
+      double fx = u - u0;
+
+      Uint32 pixel = 0xff000000;
+      for (unsigned int shift = 0; shift < 24; shift += 8) {
+        double upper = channel(top[u0], shift) * (1.0 - fx) +
+                       channel(top[u1], shift) * fx;
+        double lower = channel(bottom[u0], shift) * (1.0 - fx) +
+                       channel(bottom[u1], shift) * fx;
+        pixel |= (Uint32)std::lround(upper * (1.0 - fy) + lower * fy)
+                 << shift;
+      }
+      pixels[(size_t)j * width + i] = pixel;
+    }
+  }
+}
+
+/* Appends a frame to a y4m stream as 4:4:4 planes, converted to BT.601
+ * studio-range YUV in integers */
+void appendY4mFrame(std::vector<Uint32> const &pixels,
+                    std::vector<unsigned char> &bytes) {
+  static char const header[] = "FRAME\n";
+  size_t size = pixels.size();
+  bytes.resize(sizeof(header) - 1 + 3 * size);
+  std::copy(header, header + sizeof(header) - 1, bytes.begin());
+
+  unsigned char *y = &bytes[sizeof(header) - 1];
+  unsigned char *u = y + size;
+  unsigned char *v = u + size;
+
+  for (size_t p = 0; p < size; p++) {
+    int r = channel(pixels[p], 16);
+    int g = channel(pixels[p], 8);
+    int b = channel(pixels[p], 0);
+    y[p] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    u[p] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    v[p] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+}
+
+/* Where the frames go: a y4m stream (a file, or stdout for "-") or one PNG
+ * per frame named <prefix>-<frame>.png */
+class FrameOutput {
+public:
+  FrameOutput() = default;
+  ~FrameOutput() {
+    if (stream != nullptr && stream != stdout) {
+      std::fclose(stream);
+    }
+  }
+
+  FrameOutput(FrameOutput const &) = delete;
+  FrameOutput &operator=(FrameOutput const &) = delete;
+
+  bool open(std::string const &path, unsigned int width, unsigned int height,
+            unsigned int fps) {
+    this->width = width;
+    this->height = height;
+
+    if (path != "-" && !endsWith(path, ".y4m")) {
+      prefix = endsWith(path, ".png") ? path.substr(0, path.size() - 4) : path;
+      return true;
+    }
+
+    stream = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+    if (stream == nullptr) {
+      std::cerr << "Could not create " << path << std::endl;
+      return false;
+    }
+
+    std::ostringstream header;
+    header << "YUV4MPEG2 W" << width << " H" << height << " F" << fps
+           << ":1 Ip A1:1 C444\n";
+    return write(header.str().data(), header.str().size());
+  }
+
+  bool isStream() const { return stream != nullptr; }
+
+  std::string framePath(size_t index) const {
+    std::ostringstream path;
+    path << prefix << "-" << std::setw(5) << std::setfill('0') << index
+         << ".png";
+    return path.str();
+  }
+
+  // Safe to call for several frames at once
+  EncodedFrame encode(size_t index, std::vector<Uint32> const &pixels) const {
+    EncodedFrame encoded;
+
+    if (isStream()) {
+      appendY4mFrame(pixels, encoded.bytes);
+      return encoded;
+    }
+
+    PngWriter writer;
+    std::string path = framePath(index);
+    encoded.ok = writer.open(path, width, height) &&
+                 writer.writeRows(&pixels[0], height) && writer.finish();
+    if (!encoded.ok) {
+      std::cerr << "Could not write " << path << std::endl;
+    }
+    return encoded;
+  }
+
+  // Appends encoded frames to the stream, in the order they are given
+  bool write(EncodedFrame const &encoded) {
+    return encoded.ok &&
+           (encoded.bytes.empty() ||
+            write(encoded.bytes.data(), encoded.bytes.size()));
+  }
+
+  bool finish() { return stream == nullptr || std::fflush(stream) == 0; }
+
+  std::string describe(std::string const &path, size_t frames) const {
+    if (path == "-") {
+      return "y4m to stdout";
+    }
+    if (isStream()) {
+      return path;
+    }
+    return framePath(0) + " to " + framePath(frames - 1);
+  }
+
+private:
+  std::FILE *stream{nullptr};
+  std::string prefix;
+  unsigned int width{0};
+  unsigned int height{0};
+
+  bool write(void const *data, size_t size) {
+    if (std::fwrite(data, 1, size, stream) != size) {
+      std::cerr << "Could not write video stream" << std::endl;
+      return false;
+    }
+    return true;
+  }
+};
+
+/* Resamples, encodes and writes out the frames of a level, as many at once
+ * as there are hardware threads */
+bool writeLevel(Level const &level, std::vector<Uint32> const &level_pixels,
+                std::vector<Keyframe> const &frames, unsigned int width,
+                unsigned int height, double x_range, double y_range,
+                FrameOutput &output) {
+  size_t batch = std::max(2u, std::thread::hardware_concurrency());
+
+  for (size_t first = level.first; first < level.last; first += batch) {
+    std::vector<std::future<EncodedFrame>> encoded;
+
+    for (size_t f = first; f < std::min(first + batch, level.last); f++) {
+      encoded.push_back(std::async(std::launch::async, [&, f] {
+        std::vector<Uint32> pixels((size_t)width * height);
+        resample(level_pixels, level.view, frames[f], width, height, x_range,
+                 y_range, pixels);
+        return output.encode(f, pixels);
+      }));
+    }
+
+    bool ok = true;
+    for (std::future<EncodedFrame> &frame : encoded) {
+      ok = output.write(frame.get()) && ok;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool loadKeyframes(std::string const &path, std::vector<Keyframe> &keyframes) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Could not read " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (unsigned int number = 1; std::getline(file, line); number++) {
+    std::istringstream fields(line);
+    std::string center_x, center_y;
+    Keyframe keyframe;
+
+    if (!(fields >> center_x) || center_x[0] == '#') {
+      continue;
+    }
+
+    try {
+      fields >> center_y >> keyframe.zoom >> keyframe.max_iterations;
+      if (!fields || keyframe.zoom <= 0.0) {
+        throw std::invalid_argument(line);
+      }
+      keyframe.center_x = BigFloat::parse(center_x);
+      keyframe.center_y = BigFloat::parse(center_y);
+    } catch (std::exception const &) {
+      std::cerr << path << ":" << number
+                << ": expected <center-x> <center-y> <zoom> <iterations>"
+                << std::endl;
+      return false;
+    }
+
+    keyframes.push_back(keyframe);
+  }
+
+  if (keyframes.empty()) {
+    std::cerr << path << " has no keyframes" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+int runAnimation(AnimationOptions const &options) {
+  HeadlessOptions const &render = options.render;
+  unsigned int width = render.screen_width;
+  unsigned int height = render.screen_height;
+
+  // Levels are rendered with every pixel of the frame size subdivided
+  Mandelbrot mandelbrot(width * LEVEL_SCALE, height * LEVEL_SCALE,
+                        render.thread_count, render.tile_size);
+  applyHeadlessOptions(mandelbrot, render);
+  double x_range = mandelbrot.xRange();
+  double y_range = mandelbrot.yRange();
+
+  std::vector<Keyframe> frames =
+      interpolate(options.keyframes, std::max(1u, options.frames_per_key));
+  std::vector<Level> levels = planLevels(frames, x_range, y_range);
+
+  FrameOutput output;
+  if (!output.open(render.output_path, width, height, options.fps)) {
+    return 1;
+  }
+
+  std::cout << "Rendering " << frames.size() << " frames of " << width << "x"
+            << height << " from " << options.keyframes.size()
+            << " keyframes as " << levels.size() << " levels of "
+            << width * LEVEL_SCALE << "x" << height * LEVEL_SCALE << " on "
+            << render.thread_count << " threads ("
+            << kernelName(render.kernel) << " kernel, "
+            << renderModeName(render.mode) << ")" << std::endl;
+
+  // The frames of one level are resampled and written out while the next
+  // level renders, so two levels of pixels are held at a time
+  std::vector<Uint32> buffers[2];
+  std::future<bool> written;
+  double render_seconds = 0.0;
+  bool ok = true;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t k = 0; k < levels.size() && ok; k++) {
+    Level const &level = levels[k];
+    mandelbrot.setCenter(level.view.center_x, level.view.center_y);
+    mandelbrot.setZoom(level.view.zoom);
+    mandelbrot.setIterations(level.view.max_iterations);
+
+    std::vector<Uint32> &pixels = buffers[k % 2];
+    pixels.resize((size_t)width * height * LEVEL_SCALE * LEVEL_SCALE);
+
+    auto render_start = std::chrono::steady_clock::now();
+    mandelbrot.renderFrame(pixels);
+    render_seconds += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - render_start)
+                          .count();
+
+    if (written.valid()) {
+      ok = written.get();
+    }
+    written = std::async(std::launch::async, [&, k] {
+      return writeLevel(levels[k], buffers[k % 2], frames, width, height,
+                        x_range, y_range, output);
+    });
+
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    size_t done = k > 0 ? levels[k - 1].last : 0;
+    std::streamsize precision = std::cout.precision();
+    std::cout << "\rLevel " << k + 1 << "/" << levels.size() << " ("
+              << mandelbrot.arithmetic() << "), frame "
+              << done << "/" << frames.size() << " (" << std::fixed
+              << std::setprecision(1) << done / seconds << " frames/s)    "
+              << std::defaultfloat << std::setprecision(precision)
+              << std::flush;
+  }
+  std::cout << std::endl;
+
+  ok = (!written.valid() || written.get()) && ok && output.finish();
+  if (!ok) {
+    std::cerr << "Could not write " << render.output_path << std::endl;
+    return 1;
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  // Each level costs LEVEL_SCALE^2 frames' worth of pixels
+  double computed = (double)levels.size() * LEVEL_SCALE * LEVEL_SCALE;
+
+  std::cout << "Wall time: " << seconds << " s (rendering levels "
+            << render_seconds << " s)" << std::endl;
+  std::cout << "Throughput: " << frames.size() / seconds << " frames/s"
+            << std::endl;
+  std::cout << "Reuse: " << (double)frames.size() / levels.size()
+            << " frames per level, " << 100.0 * computed / frames.size()
+            << "% of the pixels of rendering every frame" << std::endl;
+  std::cout << "Wrote out "
+            << output.describe(render.output_path, frames.size()) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "big_float.h"
+#include "headless.h"
+#include <string>
+#include <vector>
+
+/** One view along a zoom path */
+struct Keyframe {
+  BigFloat center_x{-1.0};
+  BigFloat center_y{0.0};
+  double zoom{1.0};
+  unsigned int max_iterations{50};
+};
+
+/** A zoom video: the frame size and render parameters come from render,
+ * whose output_path is "-" for a y4m stream on stdout, a path ending in
+ * ".y4m" for a y4m file, or otherwise the prefix of numbered PNGs.
+ */
+struct AnimationOptions {
+  HeadlessOptions render;
+  std::vector<Keyframe> keyframes;
+  /* Frames from one keyframe to the next */
+  unsigned int frames_per_key{30};
+  /* Frame rate written into y4m headers */
+  unsigned int fps{30};
+};
+
+/** Read keyframes from a text file, one per line as
+ * "<center-x> <center-y> <zoom> <iterations>"; blank lines and lines starting
+ * with # are skipped. Returns false (and says why on stderr) if the file
+ * can't be read or a line doesn't parse.
+ */
+bool loadKeyframes(std::string const &path, std::vector<Keyframe> &keyframes);
+
+/** Render the frames between the keyframes and write them out as a video.
+ * Zoom is interpolated geometrically and iterations linearly; the center
+ * moves in proportion to the change in zoom, so each segment zooms in on
+ * (or out from) one fixed point.
+ *
+ * Frames aren't rendered one by one: consecutive frames share a "level", one
+ * frame rendered at twice the width and height, and are resampled from it,
+ * so a level is computed once for every frame that zooms in by up to 2x
+ * from it. Each level renders on the thread pool while the frames of the
+ * previous one are resampled, encoded and written out in parallel.
+ * Returns a process exit code.
+ */
+int runAnimation(AnimationOptions const &options);
+
+#endif
@@ -0,0 +1,377 @@
+#include "SDL.h"
+#include "kernels.h"
+#include "mandelbrot.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Benchmarks for the escape-time kernels and for whole frames.
+ *
+ * Every run covers the same named viewpoints, so the JSON it writes can be
+ * diffed against a run from another commit. Times are the best of a few
+ * repeats, which is the least noisy measure on a busy machine.
+ */
+
+/** A fixed view to benchmark */
+struct Viewpoint {
+  std::string name;
+  double center_x;
+  double center_y;
+  double zoom;
+};
+
+std::vector<Viewpoint> const VIEWPOINTS = {
+    {"full-set", -1.0, 0.0, 1.0},
+    {"seahorse-valley", -0.743643887, 0.131825904, 1e-4},
+    {"deep-minibrot", -1.7497591451303665, 0.0, 1e-5},
+};
+
+/** What to run, from the command line */
+struct BenchOptions {
+  unsigned int screen_width{800};
+  unsigned int screen_height{600};
+  std::vector<unsigned int> iterations{256, 1024, 4096};
+  std::vector<unsigned int> threads;
+  std::vector<Precision> precisions{Precision::Float, Precision::Double,
+                                    Precision::DoubleDouble};
+  unsigned int repeats{3};
+  std::string output_path{"bench.json"};
+};
+
+/** One kernel over one viewpoint in one precision, on one thread with no
+ * shortcuts
+ */
+struct KernelResult {
+  std::string viewpoint;
+  std::string kernel;
+  std::string precision;
+  unsigned int max_iterations;
+  double seconds;
+  unsigned long long iterations;
+};
+
+/** One whole frame rendered by the render thread pool */
+struct FrameResult {
+  std::string viewpoint;
+  // The arithmetic the viewer picked for the frame
+  std::string arithmetic;
+  unsigned int max_iterations;
+  unsigned int threads;
+  double seconds;
+  unsigned long long iterations;
+  double efficiency;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** Runs a kernel over every row of a viewpoint; returns the best time and
+ * the total of the iteration counts
+ */
+KernelResult benchKernel(BenchOptions const &options, Viewpoint const &view,
+                         KernelType type, Precision precision,
+                         unsigned int max_iterations) {
+  double x_range = 3.0 * view.zoom;
+  double y_range = 2.5 * view.zoom;
+
+  RowParams row;
+  row.x0 = view.center_x - x_range / 2.0;
+  row.dx = x_range / options.screen_width;
+  row.first = 0;
+  row.stride = 1;
+  row.width = options.screen_width;
+  row.max_iterations = max_iterations;
+  row.cardioid_check = false;
+  row.periodicity_check = false;
+
+  RowKernel kernel = getKernel(type, Fractal(), precision);
+  std::vector<unsigned int> counts(options.screen_width);
+
+  KernelResult result{view.name, kernelName(type), precisionName(precision),
+                      max_iterations, 1e30, 0};
+  for (unsigned int r = 0; r < options.repeats; r++) {
+    unsigned long long total = 0;
+    Clock::time_point start = Clock::now();
+
+    for (unsigned int j = 0; j < options.screen_height; j++) {
+      row.y = view.center_y - y_range / 2.0 +
+              ((double)j / options.screen_height) * y_range;
+      kernel(row, &counts[0]);
+      for (unsigned int count : counts) {
+        total += count;
+      }
+    }
+
+    result.seconds = std::min(result.seconds, secondsSince(start));
+    result.iterations = total;
+  }
+
+  return result;
+}
+
+/** Renders a viewpoint with the render thread pool, as the viewer does;
+ * returns the best time and sets the arithmetic the frame was iterated in
+ */
+double benchFrame(BenchOptions const &options, Viewpoint const &view,
+                  unsigned int max_iterations, unsigned int threads,
+                  std::string &arithmetic) {
+  std::vector<Uint32> pixels(options.screen_width * options.screen_height);
+
+  double best = 1e30;
+  for (unsigned int r = 0; r < options.repeats; r++) {
+    // A fresh viewer each time, since one would reuse its previous frame
+    Mandelbrot mandelbrot(options.screen_width, options.screen_height,
+                          threads);
+    mandelbrot.setCenter(view.center_x, view.center_y);
+    mandelbrot.setZoom(view.zoom);
+    mandelbrot.setIterations(max_iterations);
+    mandelbrot.setKernel(detectKernel());
+    mandelbrot.setResumeMemory(0);
+    mandelbrot.setCacheMemory(0);
+
+    Clock::time_point start = Clock::now();
+    mandelbrot.renderFrame(pixels);
+    best = std::min(best, secondsSince(start));
+    arithmetic = mandelbrot.arithmetic();
+  }
+
+  return best;
+}
+
+/** Parses a comma-separated list of precisions such as "float,double" */
+std::vector<Precision> parsePrecisions(std::string const &text) {
+  std::vector<Precision> precisions;
+  std::stringstream stream(text);
+  std::string item;
+
+  while (std::getline(stream, item, ',')) {
+    Precision precision;
+    if (!parsePrecision(item, precision)) {
+      throw std::invalid_argument(item);
+    }
+    precisions.push_back(precision);
+  }
+
+  return precisions;
+}
+
+/** Parses a comma-separated list of positive integers such as "1,2,4" */
+std::vector<unsigned int> parseList(std::string const &text) {
+  std::vector<unsigned int> values;
+  std::stringstream stream(text);
+  std::string item;
+
+  while (std::getline(stream, item, ',')) {
+    unsigned long value = std::stoul(item);
+    if (value == 0) {
+      throw std::invalid_argument(item);
+    }
+    values.push_back(value);
+  }
+
+  return values;
+}
+
+void usage() {
+  std::cout
+      << "Usage: MandelbrotBench [options]" << std::endl
+      << "\t--size <w> <h>: frame size in pixels (default: 800 600)"
+      << std::endl
+      << "\t--iterations <n,n,...>: iteration limits (default: "
+         "256,1024,4096)"
+      << std::endl
+      << "\t--threads <n,n,...>: thread counts for whole frames (default: "
+         "1 and powers of two up to the hardware threads)"
+      << std::endl
+      << "\t--precisions <p,p,...>: kernel arithmetic, of float, double "
+         "and double-double (default: all three)"
+      << std::endl
+      << "\t--repeats <n>: runs of each measurement, the best is kept "
+         "(default: 3)"
+      << std::endl
+      << "\t--output <path>: where to write the JSON results (default: "
+         "bench.json)"
+      << std::endl;
+}
+
+/** Reads the options; returns false (having printed why) if they are bad */
+bool parseOptions(BenchOptions &options, int argc, char *argv[]) {
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      bool has_value = i + 1 < argc;
+
+      if (arg == "--size" && i + 2 < argc) {
+        options.screen_width = std::stoul(argv[++i]);
+        options.screen_height = std::stoul(argv[++i]);
+      } else if (arg == "--iterations" && has_value) {
+        options.iterations = parseList(argv[++i]);
+      } else if (arg == "--threads" && has_value) {
+        options.threads = parseList(argv[++i]);
+      } else if (arg == "--precisions" && has_value) {
+        options.precisions = parsePrecisions(argv[++i]);
+      } else if (arg == "--repeats" && has_value) {
+        options.repeats = std::max(1ul, std::stoul(argv[++i]));
+      } else if (arg == "--output" && has_value) {
+        options.output_path = argv[++i];
+      } else {
+        usage();
+        return false;
+      }
+    }
+  } catch (...) {
+    std::cout << "Error: Please provide positive integer arguments, and "
+                 "precisions of float, double or double-double."
+              << std::endl;
+    return false;
+  }
+
+  if (options.screen_width == 0 || options.screen_height == 0) {
+    std::cout << "Error: The frame must be at least 1x1." << std::endl;
+    return false;
+  }
+
+  if (options.threads.empty()) {
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int n = 1; n < hardware; n *= 2) {
+      options.threads.push_back(n);
+    }
+    options.threads.push_back(hardware);
+  }
+
+  return true;
+}
+
+void writeJson(std::ostream &out, BenchOptions const &options,
+               std::vector<KernelResult> const &kernels,
+               std::vector<FrameResult> const &frames) {
+  double pixels = (double)options.screen_width * options.screen_height;
+
+  out << "{" << std::endl
+      << "  \"screen_width\": " << options.screen_width << "," << std::endl
+      << "  \"screen_height\": " << options.screen_height << "," << std::endl
+      << "  \"repeats\": " << options.repeats << "," << std::endl
+      << "  \"hardware_threads\": " << std::thread::hardware_concurrency()
+      << "," << std::endl
+      << "  \"frame_kernel\": \"" << kernelName(detectKernel()) << "\","
+      << std::endl;
+
+  out << "  \"kernels\": [" << std::endl;
+  for (size_t k = 0; k < kernels.size(); k++) {
+    KernelResult const &r = kernels[k];
+    out << "    {\"viewpoint\": \"" << r.viewpoint << "\", \"kernel\": \""
+        << r.kernel << "\", \"precision\": \"" << r.precision
+        << "\", \"max_iterations\": " << r.max_iterations
+        << ", \"seconds\": " << r.seconds
+        << ", \"mpixels_per_second\": " << pixels / r.seconds / 1e6
+        << ", \"iterations_per_second\": " << r.iterations / r.seconds << "}"
+        << (k + 1 < kernels.size() ? "," : "") << std::endl;
+  }
+  out << "  ]," << std::endl;
+
+  out << "  \"frames\": [" << std::endl;
+  for (size_t k = 0; k < frames.size(); k++) {
+    FrameResult const &r = frames[k];
+    out << "    {\"viewpoint\": \"" << r.viewpoint << "\", \"arithmetic\": \""
+        << r.arithmetic << "\", \"max_iterations\": " << r.max_iterations
+        << ", \"threads\": " << r.threads << ", \"seconds\": " << r.seconds
+        << ", \"mpixels_per_second\": " << pixels / r.seconds / 1e6
+        << ", \"iterations_per_second\": " << r.iterations / r.seconds
+        << ", \"scaling_efficiency\": " << r.efficiency << "}"
+        << (k + 1 < frames.size() ? "," : "") << std::endl;
+  }
+  out << "  ]" << std::endl << "}" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions options;
+  if (!parseOptions(options, argc, argv)) {
+    return 1;
+  }
+
+  double pixels = (double)options.screen_width * options.screen_height;
+  std::vector<KernelResult> kernels;
+  std::vector<FrameResult> frames;
+
+  // Kernels: one thread, every pixel iterated in full, in each precision
+  // whatever the zoom, so that the tiers' throughput can be compared
+  for (Viewpoint const &view : VIEWPOINTS) {
+    for (unsigned int max_iterations : options.iterations) {
+      for (Precision precision : options.precisions) {
+        for (KernelType type : {KernelType::Scalar, KernelType::SSE2,
+                                KernelType::AVX2, KernelType::AVX512}) {
+          if (!kernelSupported(type)) {
+            continue;
+          }
+
+          KernelResult r =
+              benchKernel(options, view, type, precision, max_iterations);
+          kernels.push_back(r);
+          std::cout << "kernel " << r.kernel << " " << r.precision << " "
+                    << view.name << " @" << max_iterations << ": "
+                    << pixels / r.seconds / 1e6 << " Mpixels/s, "
+                    << r.iterations / r.seconds / 1e9 << " Giterations/s"
+                    << std::endl;
+        }
+      }
+    }
+  }
+
+  // Frames: the whole pipeline with shortcuts, across thread counts.
+  // Iterations per second count the iterations the frame stands for (as
+  // the kernels above computed them), not the ones shortcuts skipped.
+  for (Viewpoint const &view : VIEWPOINTS) {
+    for (unsigned int max_iterations : options.iterations) {
+      // Any precision will do, since the counts only differ on a few
+      // boundary pixels
+      unsigned long long iterations = 0;
+      for (KernelResult const &r : kernels) {
+        if (r.viewpoint == view.name && r.max_iterations == max_iterations) {
+          iterations = r.iterations;
+        }
+      }
+
+      // Scaling is measured against the first thread count, taken to be
+      // perfectly efficient (it is 1 unless --threads says otherwise)
+      double serial_seconds = 0.0;
+      for (unsigned int threads : options.threads) {
+        std::string arithmetic;
+        double seconds =
+            benchFrame(options, view, max_iterations, threads, arithmetic);
+        if (serial_seconds == 0.0) {
+          serial_seconds = seconds * threads;
+        }
+
+        double efficiency = serial_seconds / seconds / threads;
+        frames.push_back(FrameResult{view.name, arithmetic, max_iterations,
+                                     threads, seconds, iterations,
+                                     efficiency});
+        std::cout << "frame " << view.name << " (" << arithmetic << ") @"
+                  << max_iterations << " x" << threads << ": "
+                  << seconds * 1000.0 << " ms, "
+                  << pixels / seconds / 1e6 << " Mpixels/s, "
+                  << 100.0 * efficiency << "% scaling efficiency"
+                  << std::endl;
+      }
+    }
+  }
+
+  std::ofstream out(options.output_path);
+  writeJson(out, options, kernels, frames);
+  if (!out) {
+    std::cerr << "Could not write " << options.output_path << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote out " << options.output_path << std::endl;
+  return 0;
+}
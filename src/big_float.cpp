@@ -0,0 +1,263 @@
+#include "big_float.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+/* Bits in one limb, as a double scale factor */
+constexpr double LIMB_SCALE = 18446744073709551616.0; // 2^64
+
+/* Deepest precision we'll ever allocate (about 1e-600) */
+constexpr unsigned int MAX_FRACTION_LIMBS = 32;
+
+unsigned int BigFloat::precisionFor(double feature_size) {
+  if (feature_size <= 0.0 || !std::isfinite(feature_size)) {
+    return 1;
+  }
+
+  // One spare limb of guard bits below the feature size
+  int bits = std::max(0, -std::ilogb(feature_size)) + 64;
+  return std::min(MAX_FRACTION_LIMBS, (unsigned int)(bits + 63) / 64);
+}
+
+BigFloat::BigFloat(double value) {
+  unsigned int fraction_limbs = 1;
+
+  if (value != 0.0 && std::isfinite(value)) {
+    // The lowest set bit of a double is 52 places below its leading bit
+    int lowest_bit = std::ilogb(value) - 52;
+    if (lowest_bit < 0) {
+      fraction_limbs = std::min(MAX_FRACTION_LIMBS,
+                                (unsigned int)(-lowest_bit + 63) / 64);
+    }
+  }
+
+  *this = BigFloat(value, fraction_limbs);
+}
+
+BigFloat::BigFloat(double value, unsigned int fraction_limbs)
+    : limbs(fraction_limbs + 1, 0) {
+  if (!std::isfinite(value)) {
+    return;
+  }
+
+  bool negative = value < 0;
+  double magnitude = std::abs(value);
+  double integer_part = std::floor(magnitude);
+  double fraction = magnitude - integer_part;
+
+  limbs.back() = (uint64_t)integer_part;
+
+  // Scaling by 2^64 and splitting off the integer part is exact
+  for (int k = (int)fraction_limbs - 1; k >= 0 && fraction > 0.0; k--) {
+    fraction *= LIMB_SCALE;
+    double limb = std::floor(fraction);
+    limbs[k] = (uint64_t)limb;
+    fraction -= limb;
+  }
+
+  if (negative) {
+    negate();
+  }
+}
+
+BigFloat BigFloat::parse(std::string const &text) {
+  std::string integer_digits;
+  std::string fraction_digits;
+  bool negative = false;
+  long exponent = 0;
+
+  size_t i = 0;
+  if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+    negative = text[i] == '-';
+    i++;
+  }
+  while (i < text.size() && std::isdigit((unsigned char)text[i])) {
+    integer_digits += text[i++];
+  }
+  if (i < text.size() && text[i] == '.') {
+    i++;
+    while (i < text.size() && std::isdigit((unsigned char)text[i])) {
+      fraction_digits += text[i++];
+    }
+  }
+  if (integer_digits.empty() && fraction_digits.empty()) {
+    throw std::invalid_argument(text);
+  }
+  if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+    size_t used = 0;
+    exponent = std::stol(text.substr(i + 1), &used);
+    i += used + 1;
+  }
+  if (i != text.size()) {
+    throw std::invalid_argument(text);
+  }
+
+  // log2(10) bits per decimal digit, plus a guard limb
+  long decimal_places = (long)fraction_digits.size() - exponent;
+  unsigned int fraction_limbs = std::min<long>(
+      MAX_FRACTION_LIMBS,
+      std::max<long>(1, (long)(std::max(0L, decimal_places) * 3.33) / 64 + 2));
+
+  BigFloat result(0.0, fraction_limbs);
+
+  // Fraction by Horner's rule from the last digit: f = (d + f) / 10
+  for (auto it = fraction_digits.rbegin(); it != fraction_digits.rend();
+       it++) {
+    result.limbs.back() += *it - '0';
+    result.divideSmall(10);
+  }
+
+  // Integer part digit by digit
+  BigFloat integer(0.0, fraction_limbs);
+  for (char digit : integer_digits) {
+    integer.multiplySmall(10);
+    integer.limbs.back() += digit - '0';
+  }
+  result = result + integer;
+
+  for (; exponent > 0; exponent--) {
+    result.multiplySmall(10);
+  }
+  for (; exponent < 0; exponent++) {
+    result.divideSmall(10);
+  }
+
+  if (negative) {
+    result.negate();
+  }
+
+  return result;
+}
+
+double BigFloat::toDouble() const {
+  BigFloat magnitude = isNegative() ? -*this : *this;
+
+  double result = 0.0;
+  for (unsigned int k = 0; k < magnitude.limbs.size(); k++) {
+    result += std::ldexp((double)magnitude.limbs[k],
+                         64 * ((int)k - (int)precision()));
+  }
+
+  return isNegative() ? -result : result;
+}
+
+std::string BigFloat::toString(unsigned int digits) const {
+  BigFloat magnitude = isNegative() ? -*this : *this;
+
+  std::string result = isNegative() ? "-" : "";
+  result += std::to_string(magnitude.limbs.back()) + ".";
+
+  magnitude.limbs.back() = 0;
+  for (unsigned int d = 0; d < digits; d++) {
+    magnitude.multiplySmall(10);
+    result += (char)('0' + magnitude.limbs.back());
+    magnitude.limbs.back() = 0;
+  }
+
+  return result;
+}
+
+BigFloat BigFloat::withPrecision(unsigned int fraction_limbs) const {
+  BigFloat result = *this;
+
+  if (fraction_limbs > precision()) {
+    result.limbs.insert(result.limbs.begin(), fraction_limbs - precision(),
+                        0);
+  } else if (fraction_limbs < precision()) {
+    result.limbs.erase(result.limbs.begin(),
+                       result.limbs.begin() + (precision() - fraction_limbs));
+  }
+
+  return result;
+}
+
+BigFloat BigFloat::operator-() const {
+  BigFloat result = *this;
+  result.negate();
+  return result;
+}
+
+BigFloat BigFloat::operator+(BigFloat const &other) const {
+  unsigned int fraction_limbs = std::max(precision(), other.precision());
+  BigFloat a = withPrecision(fraction_limbs);
+  BigFloat b = other.withPrecision(fraction_limbs);
+
+  unsigned __int128 carry = 0;
+  for (unsigned int k = 0; k < a.limbs.size(); k++) {
+    carry += (unsigned __int128)a.limbs[k] + b.limbs[k];
+    a.limbs[k] = (uint64_t)carry;
+    carry >>= 64;
+  }
+
+  return a;
+}
+
+BigFloat BigFloat::operator-(BigFloat const &other) const {
+  return *this + (-other);
+}
+
+BigFloat BigFloat::operator*(BigFloat const &other) const {
+  unsigned int fraction_limbs = std::max(precision(), other.precision());
+  BigFloat a = withPrecision(fraction_limbs);
+  BigFloat b = other.withPrecision(fraction_limbs);
+
+  bool negative = a.isNegative() != b.isNegative();
+  if (a.isNegative()) {
+    a.negate();
+  }
+  if (b.isNegative()) {
+    b.negate();
+  }
+
+  // Schoolbook multiply of the magnitudes, keeping the limbs that line up
+  // with the binary point again
+  size_t n = a.limbs.size();
+  std::vector<uint64_t> product(2 * n, 0);
+
+  for (size_t i = 0; i < n; i++) {
+    unsigned __int128 carry = 0;
+    for (size_t j = 0; j < n; j++) {
+      carry += (unsigned __int128)a.limbs[i] * b.limbs[j] + product[i + j];
+      product[i + j] = (uint64_t)carry;
+      carry >>= 64;
+    }
+    product[i + n] = (uint64_t)carry;
+  }
+
+  std::copy(product.begin() + fraction_limbs,
+            product.begin() + fraction_limbs + n, a.limbs.begin());
+
+  if (negative) {
+    a.negate();
+  }
+
+  return a;
+}
+
+void BigFloat::negate() {
+  unsigned __int128 carry = 1;
+  for (auto &limb : limbs) {
+    carry += (uint64_t)~limb;
+    limb = (uint64_t)carry;
+    carry >>= 64;
+  }
+}
+
+void BigFloat::multiplySmall(uint32_t factor) {
+  unsigned __int128 carry = 0;
+  for (auto &limb : limbs) {
+    carry += (unsigned __int128)limb * factor;
+    limb = (uint64_t)carry;
+    carry >>= 64;
+  }
+}
+
+void BigFloat::divideSmall(uint32_t divisor) {
+  unsigned __int128 remainder = 0;
+  for (auto it = limbs.rbegin(); it != limbs.rend(); it++) {
+    unsigned __int128 current = (remainder << 64) | *it;
+    *it = (uint64_t)(current / divisor);
+    remainder = current % divisor;
+  }
+}
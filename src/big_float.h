@@ -0,0 +1,56 @@
+#ifndef BIG_FLOAT_H
+#define BIG_FLOAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A signed fixed-point number with as many fractional bits as needed.
+ *
+ * The value is stored as a two's complement integer in 64-bit limbs (least
+ * significant first) scaled by 2^(-64 * precision()); the top limb holds the
+ * integer part. This is plenty for points on the complex plane, which never
+ * stray far from the origin, and lets deep-zoom views keep their center
+ * exactly however far in they go.
+ *
+ * Arithmetic between numbers of different precision happens at the larger
+ * of the two precisions.
+ */
+class BigFloat {
+public:
+  BigFloat() : BigFloat(0.0) {}
+  // Exact conversion, with just enough limbs to hold every bit of value
+  BigFloat(double value);
+  BigFloat(double value, unsigned int fraction_limbs);
+
+  // Parses a decimal such as "-0.7436438870371587522", optionally with an
+  // exponent. Throws std::invalid_argument for anything else.
+  static BigFloat parse(std::string const &text);
+
+  double toDouble() const;
+  std::string toString(unsigned int digits) const;
+
+  // Number of 64-bit limbs after the binary point
+  unsigned int precision() const { return limbs.size() - 1; }
+  BigFloat withPrecision(unsigned int fraction_limbs) const;
+
+  bool isNegative() const { return (int64_t)limbs.back() < 0; }
+
+  BigFloat operator-() const;
+  BigFloat operator+(BigFloat const &other) const;
+  BigFloat operator-(BigFloat const &other) const;
+  BigFloat operator*(BigFloat const &other) const;
+
+  // Fractional limbs needed to resolve features of the given size
+  static unsigned int precisionFor(double feature_size);
+
+private:
+  std::vector<uint64_t> limbs;
+
+  void negate();
+  void multiplySmall(uint32_t factor);
+  void divideSmall(uint32_t divisor);
+};
+
+#endif
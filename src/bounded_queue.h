@@ -0,0 +1,170 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+/**
+ * A bounded multi-producer, multi-consumer FIFO queue.
+ *
+ * Pushing and popping are lock-free (Vyukov's ring of sequenced cells): each
+ * cell's sequence number says whether it is ready to be written or read in
+ * the current lap of the ring, and producers and consumers claim cells by
+ * compare-and-swap on their own position counters.
+ *
+ * pop() blocks while the queue is empty. Only a consumer that finds nothing
+ * takes the mutex and sleeps on the condition variable, and only a producer
+ * that sees a sleeper notifies it, so neither side polls or pays for the
+ * mutex while there is work. close() wakes every sleeper for a clean
+ * shutdown.
+ */
+template <class T> class BoundedQueue {
+public:
+  // capacity is rounded up to a power of two
+  explicit BoundedQueue(size_t capacity);
+
+  // add a value; false (leaving value alone) if the queue is full
+  bool tryPush(T &&value);
+  // take the oldest value, if there is one
+  std::optional<T> tryPop();
+  // take the oldest value, waiting for one; empty once the queue is closed
+  std::optional<T> pop();
+  // wake all waiting consumers and have pop() stop waiting
+  void close();
+
+  // true if nothing is queued (a snapshot while others push and pop)
+  bool empty() const;
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  // producers and consumers move their positions on separate cache lines
+  alignas(64) std::atomic<size_t> push_position{0};
+  alignas(64) std::atomic<size_t> pop_position{0};
+  alignas(64) std::atomic<unsigned int> sleepers{0};
+  std::atomic<bool> closed{false};
+
+  size_t mask;
+  std::unique_ptr<Cell[]> cells;
+
+  std::mutex mutex;
+  std::condition_variable available;
+};
+
+template <class T> BoundedQueue<T>::BoundedQueue(size_t capacity) {
+  size_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  mask = size - 1;
+  cells = std::make_unique<Cell[]>(size);
+  for (size_t i = 0; i < size; i++) {
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <class T> bool BoundedQueue<T>::tryPush(T &&value) {
+  Cell *cell;
+  size_t position = push_position.load(std::memory_order_relaxed);
+
+  while (true) {
+    cell = &cells[position & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    long difference = (long)sequence - (long)position;
+
+    if (difference == 0) {
+      // The cell is free in this lap; claim it
+      if (push_position.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The cell still holds a value from the previous lap
+      return false;
+    } else {
+      position = push_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->value = std::move(value);
+  cell->sequence.store(position + 1, std::memory_order_release);
+
+  // Pairs with the fence in pop(): either a consumer about to sleep sees
+  // this value, or this producer sees the consumer and wakes it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    available.notify_one();
+  }
+
+  return true;
+}
+
+template <class T> std::optional<T> BoundedQueue<T>::tryPop() {
+  Cell *cell;
+  size_t position = pop_position.load(std::memory_order_relaxed);
+
+  while (true) {
+    cell = &cells[position & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    long difference = (long)sequence - (long)(position + 1);
+
+    if (difference == 0) {
+      if (pop_position.compare_exchange_weak(position, position + 1,
+                                             std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // Nothing written to this cell yet
+      return {};
+    } else {
+      position = pop_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  T value = std::move(cell->value);
+  // Free the cell for the producer one lap ahead
+  cell->sequence.store(position + mask + 1, std::memory_order_release);
+  return value;
+}
+
+template <class T> std::optional<T> BoundedQueue<T>::pop() {
+  while (true) {
+    if (std::optional<T> value = tryPop()) {
+      return value;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    sleepers.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    available.wait(lock, [this] { return !empty() || closed; });
+    sleepers.fetch_sub(1, std::memory_order_relaxed);
+
+    if (closed && empty()) {
+      return {};
+    }
+  }
+}
+
+template <class T> void BoundedQueue<T>::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+  }
+  available.notify_all();
+}
+
+template <class T> bool BoundedQueue<T>::empty() const {
+  return pop_position.load(std::memory_order_seq_cst) >=
+         push_position.load(std::memory_order_seq_cst);
+}
+
+#endif
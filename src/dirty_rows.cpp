@@ -0,0 +1,87 @@
+#include "dirty_rows.h"
+#include <algorithm>
+
+namespace {
+
+unsigned long long packSpan(unsigned int x0, unsigned int x1) {
+  return (unsigned long long)x0 << 32 | x1;
+}
+
+unsigned int spanStart(unsigned long long span) { return span >> 32; }
+unsigned int spanEnd(unsigned long long span) { return span & 0xffffffff; }
+
+} // namespace
+
+DirtyRows::DirtyRows(unsigned int width, unsigned int height)
+    : width(width), height(height),
+      rows(std::make_unique<std::atomic<unsigned long long>[]>(height)) {
+  for (unsigned int j = 0; j < height; j++) {
+    rows[j].store(0, std::memory_order_relaxed);
+  }
+}
+
+void DirtyRows::mark(unsigned int x0, unsigned int y0, unsigned int x1,
+                     unsigned int y1) {
+  x1 = std::min(x1, width);
+  y1 = std::min(y1, height);
+  if (x0 >= x1) {
+    return;
+  }
+
+  for (unsigned int j = y0; j < y1; j++) {
+    unsigned long long old_span = rows[j].load(std::memory_order_relaxed);
+    unsigned long long new_span;
+    do {
+      new_span = old_span == 0
+                     ? packSpan(x0, x1)
+                     : packSpan(std::min(x0, spanStart(old_span)),
+                                std::max(x1, spanEnd(old_span)));
+    } while (new_span != old_span &&
+             !rows[j].compare_exchange_weak(old_span, new_span,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed));
+  }
+}
+
+void DirtyRows::markAll() { mark(0, 0, width, height); }
+
+bool DirtyRows::any() const {
+  for (unsigned int j = 0; j < height; j++) {
+    if (rows[j].load(std::memory_order_relaxed) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<SDL_Rect> DirtyRows::take() {
+  std::vector<SDL_Rect> rects;
+  unsigned int x0 = 0, x1 = 0;
+
+  for (unsigned int j = 0; j < height; j++) {
+    // Acquire pairs with the marking thread's release, so the pixels it
+    // wrote before marking are seen by the upload
+    unsigned long long span = rows[j].exchange(0, std::memory_order_acquire);
+    if (span == 0) {
+      continue;
+    }
+
+    unsigned int start = spanStart(span);
+    unsigned int end = spanEnd(span);
+
+    SDL_Rect *last = rects.empty() ? nullptr : &rects.back();
+    if (last && last->y + last->h == (int)j && start < x1 && x0 < end) {
+      x0 = std::min(x0, start);
+      x1 = std::max(x1, end);
+      last->x = x0;
+      last->w = x1 - x0;
+      last->h++;
+    } else {
+      x0 = start;
+      x1 = end;
+      rects.push_back(SDL_Rect{(int)x0, (int)j, (int)(x1 - x0), 1});
+    }
+  }
+
+  return rects;
+}
@@ -0,0 +1,39 @@
+#ifndef DIRTY_ROWS_H
+#define DIRTY_ROWS_H
+
+#include "SDL.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * Tracks which pixels of a frame buffer changed since the screen was last
+ * updated, as one span [x0, x1) per row.
+ *
+ * Render threads mark what they write and the main thread takes the spans
+ * to upload; each row's span is a single atomic word, so neither side locks
+ * and no mark made while the spans are taken is lost.
+ */
+class DirtyRows {
+public:
+  DirtyRows(unsigned int width, unsigned int height);
+
+  // marks pixels [x0, x1) x [y0, y1), clipped to the buffer
+  void mark(unsigned int x0, unsigned int y0, unsigned int x1,
+            unsigned int y1);
+  void markAll();
+
+  // true if anything was marked since the last take()
+  bool any() const;
+  // clears the marks, returning rectangles covering them; runs of rows
+  // whose spans overlap are merged into one rectangle
+  std::vector<SDL_Rect> take();
+
+private:
+  unsigned int width;
+  unsigned int height;
+  // x0 in the high half, x1 in the low half; 0 for a clean row
+  std::unique_ptr<std::atomic<unsigned long long>[]> rows;
+};
+
+#endif
@@ -0,0 +1,567 @@
+#include "distributed.h"
+#include "mandelbrot.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+/* Edge of the square tiles dealt out to workers: big enough that a worker's
+ * own render threads have plenty of their tiles to share out, and that the
+ * round trip of a tile is small next to computing it */
+constexpr unsigned int NETWORK_TILE_SIZE = 256;
+/* Tiles sent to a worker ahead of the one it is on, so that it doesn't sit
+ * idle waiting on the network between tiles */
+constexpr size_t TILES_IN_FLIGHT = 2;
+/* A worker that sends nothing for this long is taken to be lost */
+constexpr int WORKER_TIMEOUT_SECONDS = 60;
+/* Workers on a tile say so this often, however long the tile takes, so that
+ * only silence counts towards the timeout */
+constexpr int KEEPALIVE_SECONDS = 10;
+/* Longest header line accepted; centers of deep views run to many digits */
+constexpr size_t MAX_LINE = 1 << 16;
+
+/* A rectangle of the frame for one worker to compute */
+struct NetworkTile {
+  unsigned int x0;
+  unsigned int y0;
+  unsigned int width;
+  unsigned int height;
+};
+
+/* How one worker got on */
+struct WorkerReport {
+  unsigned long tiles{0};
+  unsigned long long pixels{0};
+  bool lost{false};
+  std::string reason;
+};
+
+/* The frame being rendered and its tiles, shared by the threads talking to
+ * the workers. Tiles are taken from pending, and put back there if the
+ * worker they went to is lost. */
+struct SharedFrame {
+  HeadlessOptions const &options;
+  std::vector<NetworkTile> tiles;
+  std::vector<unsigned int> counts;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<size_t> pending;
+  size_t remaining;
+  unsigned int live_workers;
+  unsigned long redispatched{0};
+
+  explicit SharedFrame(HeadlessOptions const &options) : options(options) {}
+};
+
+bool sendAll(int fd, void const *data, size_t size) {
+  char const *bytes = static_cast<char const *>(data);
+
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, 0);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+bool receiveAll(int fd, void *data, size_t size) {
+  char *bytes = static_cast<char *>(data);
+
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool sendLine(int fd, std::string const &line) {
+  return sendAll(fd, (line + "\n").data(), line.size() + 1);
+}
+
+/* Reads up to a newline, which is dropped. Header lines are short, so this
+ * reads a byte at a time rather than buffering past the end of the line. */
+bool receiveLine(int fd, std::string &line) {
+  line.clear();
+  char c;
+  while (line.size() < MAX_LINE && receiveAll(fd, &c, 1)) {
+    if (c == '\n') {
+      return true;
+    }
+    line += c;
+  }
+  return false;
+}
+
+void setNoDelay(int fd) {
+  int yes = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+
+/* Connects to a worker, giving up on reads after WORKER_TIMEOUT_SECONDS of
+ * silence; returns -1 if it can't be reached */
+int connectTo(WorkerAddress const &address) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *found = nullptr;
+
+  if (getaddrinfo(address.host.c_str(), std::to_string(address.port).c_str(),
+                  &hints, &found) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo *candidate = found; candidate && fd < 0;
+       candidate = candidate->ai_next) {
+    fd = socket(candidate->ai_family, candidate->ai_socktype,
+                candidate->ai_protocol);
+    if (fd >= 0 &&
+        connect(fd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(found);
+
+  if (fd >= 0) {
+    setNoDelay(fd);
+    timeval timeout{WORKER_TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+  return fd;
+}
+
+std::string describe(WorkerAddress const &address) {
+  return address.host + ":" + std::to_string(address.port);
+}
+
+/* The view and render parameters of a frame, which workers apply before
+ * cropping to each tile; doubles are written with every digit they have */
+std::string viewLine(HeadlessOptions const &options) {
+  std::ostringstream line;
+  // Every digit of the centers, which are exact binary fractions
+  unsigned int digits_x = 64 * options.center_x.precision() + 1;
+  unsigned int digits_y = 64 * options.center_y.precision() + 1;
+  line << std::setprecision(17) << "VIEW "
+       << options.center_x.toString(digits_x) << " "
+       << options.center_y.toString(digits_y) << " " << options.zoom << " "
+       << options.use_bounds << " " << options.x_min << " " << options.x_max
+       << " " << options.y_min << " " << options.y_max << " "
+       << options.max_iterations << " " << renderModeName(options.mode) << " "
+       << options.shortcuts.cardioid << " " << options.shortcuts.periodicity
+       << " " << options.shortcuts.symmetry << " "
+       << formulaName(options.fractal.formula) << " " << options.fractal.power
+       << " " << options.fractal.c_r << " " << options.fractal.c_i << " "
+       << (options.precision ? precisionName(*options.precision) : "auto");
+  return line.str();
+}
+
+bool parseView(std::istringstream &fields, HeadlessOptions &options) {
+  std::string center_x, center_y, mode, formula, precision;
+  fields >> center_x >> center_y >> options.zoom >> options.use_bounds >>
+      options.x_min >> options.x_max >> options.y_min >> options.y_max >>
+      options.max_iterations >> mode >> options.shortcuts.cardioid >>
+      options.shortcuts.periodicity >> options.shortcuts.symmetry >> formula >>
+      options.fractal.power >> options.fractal.c_r >> options.fractal.c_i >>
+      precision;
+
+  try {
+    options.center_x = BigFloat::parse(center_x);
+    options.center_y = BigFloat::parse(center_y);
+  } catch (std::invalid_argument const &) {
+    return false;
+  }
+
+  Precision parsed;
+  if (precision == "auto") {
+    options.precision.reset();
+  } else if (parsePrecision(precision, parsed)) {
+    options.precision = parsed;
+  } else {
+    return false;
+  }
+  return fields && parseRenderMode(mode, options.mode) &&
+         parseFormula(formula, options.fractal.formula);
+}
+
+/* Sends "WORKING <id>" every KEEPALIVE_SECONDS from a thread of its own,
+ * until destroyed. Nothing else may be sent on fd in the meantime. */
+class KeepAlive {
+public:
+  KeepAlive(int fd, unsigned long id)
+      : thread([this, fd, id] {
+          std::string line = "WORKING " + std::to_string(id);
+          std::unique_lock<std::mutex> guard(lock);
+          while (!wake.wait_for(guard, std::chrono::seconds(KEEPALIVE_SECONDS),
+                                [this] { return done; })) {
+            sendLine(fd, line);
+          }
+        }) {}
+
+  ~KeepAlive() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      done = true;
+    }
+    wake.notify_all();
+    thread.join();
+  }
+
+private:
+  std::mutex lock;
+  std::condition_variable wake;
+  bool done{false};
+  // Last, so that the rest is set up before the thread starts
+  std::thread thread;
+};
+
+/* Iteration counts go over the wire as 32-bit little-endian words */
+void encodeCounts(std::vector<unsigned int> const &counts,
+                  std::vector<unsigned char> &bytes) {
+  bytes.resize(4 * counts.size());
+  for (size_t p = 0; p < counts.size(); p++) {
+    for (unsigned int b = 0; b < 4; b++) {
+      bytes[4 * p + b] = (counts[p] >> (8 * b)) & 0xff;
+    }
+  }
+}
+
+void decodeCounts(unsigned char const *bytes, size_t count,
+                  unsigned int *counts) {
+  for (size_t p = 0; p < count; p++) {
+    counts[p] = bytes[4 * p] | bytes[4 * p + 1] << 8 |
+                bytes[4 * p + 2] << 16 | (unsigned int)bytes[4 * p + 3] << 24;
+  }
+}
+
+/* Answers one coordinator's tiles until it hangs up */
+void serveCoordinator(int fd, HeadlessOptions const &options) {
+  HeadlessOptions view = options;
+  // Colours are the coordinator's business, so there is nothing to smooth
+  // or equalise
+  view.antialias = 0;
+  view.colouring = Colouring::Linear;
+  bool have_view = false;
+  std::unique_ptr<Mandelbrot> mandelbrot;
+  std::vector<Uint32> pixels;
+  std::vector<unsigned char> bytes;
+  unsigned long tiles = 0;
+  std::string line;
+
+  while (receiveLine(fd, line)) {
+    std::istringstream fields(line);
+    std::string type;
+    fields >> type;
+
+    if (type == "VIEW") {
+      have_view = parseView(fields, view);
+      if (!have_view) {
+        sendLine(fd, "ERROR bad view");
+        break;
+      }
+      continue;
+    }
+
+    unsigned long id;
+    unsigned int full_width, full_height, x0, y0, width, height;
+    fields >> id >> full_width >> full_height >> x0 >> y0 >> width >> height;
+    if (type != "TILE" || !have_view || !fields || width == 0 ||
+        height == 0 || x0 + width > full_width || y0 + height > full_height) {
+      sendLine(fd, "ERROR bad tile");
+      break;
+    }
+
+    // Edge tiles are smaller, and need a frame of their own size
+    if (!mandelbrot || pixels.size() != (size_t)width * height) {
+      mandelbrot = std::make_unique<Mandelbrot>(
+          width, height, options.thread_count, options.tile_size);
+      pixels.resize((size_t)width * height);
+    }
+    applyHeadlessOptions(*mandelbrot, view);
+    mandelbrot->cropTo(full_width, full_height, x0, y0);
+    {
+      KeepAlive keep_alive(fd, id);
+      mandelbrot->renderFrame(pixels);
+    }
+
+    encodeCounts(mandelbrot->iterationCounts(), bytes);
+    if (!sendLine(fd, "DONE " + std::to_string(id)) ||
+        !sendAll(fd, bytes.data(), bytes.size())) {
+      break;
+    }
+    tiles++;
+  }
+
+  std::cout << "Served " << tiles << " tiles" << std::endl;
+}
+
+/* Feeds tiles to one worker and collects what it sends back, until there
+ * are none left. If the worker is lost, its tiles go back to pending. */
+void driveWorker(SharedFrame &shared, WorkerAddress const &address,
+                 WorkerReport &report) {
+  std::deque<size_t> in_flight;
+  std::vector<unsigned char> bytes;
+  std::string line;
+  unsigned int full_width = shared.options.screen_width;
+  unsigned int full_height = shared.options.screen_height;
+
+  int fd = connectTo(address);
+  bool ok = fd >= 0 && sendLine(fd, viewLine(shared.options));
+  report.reason = "could not connect";
+
+  while (ok) {
+    std::vector<size_t> taken;
+    {
+      std::unique_lock<std::mutex> guard(shared.lock);
+      // With nothing out, wait for tiles: a lost worker's may come back
+      shared.changed.wait(guard, [&] {
+        return !in_flight.empty() || !shared.pending.empty() ||
+               shared.remaining == 0;
+      });
+      if (shared.remaining == 0) {
+        break;
+      }
+      while (in_flight.size() + taken.size() < TILES_IN_FLIGHT &&
+             !shared.pending.empty()) {
+        taken.push_back(shared.pending.front());
+        shared.pending.pop_front();
+      }
+    }
+
+    for (size_t id : taken) {
+      NetworkTile const &tile = shared.tiles[id];
+      std::ostringstream request;
+      request << "TILE " << id << " " << full_width << " " << full_height
+              << " " << tile.x0 << " " << tile.y0 << " " << tile.width << " "
+              << tile.height;
+      in_flight.push_back(id);
+      ok = ok && sendLine(fd, request.str());
+    }
+
+    // Workers answer in the order they were asked, with WORKING lines while
+    // a tile takes long
+    size_t id = in_flight.front();
+    NetworkTile const &tile = shared.tiles[id];
+    bytes.resize(4 * (size_t)tile.width * tile.height);
+    report.reason = "connection lost";
+    do {
+      ok = ok && receiveLine(fd, line);
+    } while (ok && line.compare(0, 8, "WORKING ") == 0);
+    ok = ok && line == "DONE " + std::to_string(id) &&
+         receiveAll(fd, bytes.data(), bytes.size());
+    if (!ok) {
+      if (line.compare(0, 6, "ERROR ") == 0) {
+        report.reason = line.substr(6);
+      }
+      break;
+    }
+
+    // Tiles don't overlap, so their rows can be copied in without the lock
+    for (unsigned int j = 0; j < tile.height; j++) {
+      decodeCounts(&bytes[4 * (size_t)j * tile.width], tile.width,
+                   &shared.counts[(size_t)(tile.y0 + j) * full_width +
+                                  tile.x0]);
+    }
+    in_flight.pop_front();
+    report.tiles++;
+    report.pixels += (unsigned long long)tile.width * tile.height;
+
+    std::lock_guard<std::mutex> guard(shared.lock);
+    shared.remaining--;
+    shared.changed.notify_all();
+  }
+
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  if (!ok) {
+    std::lock_guard<std::mutex> guard(shared.lock);
+    report.lost = true;
+    shared.pending.insert(shared.pending.begin(), in_flight.begin(),
+                          in_flight.end());
+    shared.redispatched += in_flight.size();
+    shared.live_workers--;
+    shared.changed.notify_all();
+  }
+}
+
+} // namespace
+
+bool parseWorkerAddresses(std::string const &text,
+                          std::vector<WorkerAddress> &workers) {
+  std::istringstream list(text);
+  std::string item;
+
+  while (std::getline(list, item, ',')) {
+    size_t colon = item.rfind(':');
+    WorkerAddress address;
+    address.host = colon == std::string::npos ? "localhost"
+                                              : item.substr(0, colon);
+    std::string port =
+        colon == std::string::npos ? item : item.substr(colon + 1);
+
+    try {
+      unsigned long number = std::stoul(port);
+      if (number == 0 || number > 65535 || address.host.empty()) {
+        return false;
+      }
+      address.port = number;
+    } catch (std::exception const &) {
+      return false;
+    }
+    workers.push_back(address);
+  }
+
+  return !workers.empty();
+}
+
+int runWorker(HeadlessOptions const &options, unsigned short port) {
+  // A coordinator hanging up mid-tile mustn't kill the worker
+  signal(SIGPIPE, SIG_IGN);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if (listener < 0 ||
+      bind(listener, (sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 8) != 0) {
+    std::cerr << "Could not listen on port " << port << ": "
+              << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::cout << "Worker listening on port " << port << " ("
+            << options.thread_count << " threads, "
+            << kernelName(options.kernel) << " kernel)" << std::endl;
+
+  while (true) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    setNoDelay(fd);
+    serveCoordinator(fd, options);
+    close(fd);
+  }
+}
+
+int runCoordinator(HeadlessOptions const &options,
+                   std::vector<WorkerAddress> const &workers) {
+  // Lost workers are noticed as failed sends rather than signals
+  signal(SIGPIPE, SIG_IGN);
+
+  unsigned int width = options.screen_width;
+  unsigned int height = options.screen_height;
+
+  SharedFrame shared(options);
+  shared.counts.resize((size_t)width * height);
+  for (unsigned int y0 = 0; y0 < height; y0 += NETWORK_TILE_SIZE) {
+    for (unsigned int x0 = 0; x0 < width; x0 += NETWORK_TILE_SIZE) {
+      shared.pending.push_back(shared.tiles.size());
+      shared.tiles.push_back(
+          NetworkTile{x0, y0, std::min(NETWORK_TILE_SIZE, width - x0),
+                      std::min(NETWORK_TILE_SIZE, height - y0)});
+    }
+  }
+  shared.remaining = shared.tiles.size();
+  shared.live_workers = workers.size();
+
+  std::cout << "Rendering " << width << "x" << height << " at "
+            << options.max_iterations << " iterations on " << workers.size()
+            << " workers in " << shared.tiles.size() << " tiles of "
+            << NETWORK_TILE_SIZE << "px (" << renderModeName(options.mode)
+            << ")" << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<WorkerReport> reports(workers.size());
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < workers.size(); w++) {
+    threads.emplace_back(driveWorker, std::ref(shared), std::cref(workers[w]),
+                         std::ref(reports[w]));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  for (size_t w = 0; w < workers.size(); w++) {
+    std::cout << "Worker " << describe(workers[w]) << ": " << reports[w].tiles
+              << " tiles, " << reports[w].pixels / 1e6 / seconds
+              << " Mpixels/s";
+    if (reports[w].lost) {
+      std::cout << " (lost: " << reports[w].reason << ")";
+    }
+    std::cout << std::endl;
+  }
+  if (shared.redispatched > 0) {
+    std::cout << "Re-dispatched " << shared.redispatched
+              << " tiles from lost workers" << std::endl;
+  }
+
+  if (shared.remaining > 0) {
+    std::cerr << "All workers were lost with " << shared.remaining << " of "
+              << shared.tiles.size() << " tiles left" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wall time: " << seconds * 1000.0 << " ms" << std::endl;
+  std::cout << "Throughput: " << (double)width * height / 1e6 / seconds
+            << " Mpixels/s over " << workers.size() << " workers"
+            << std::endl;
+
+  // Counts are coloured here, so every worker's tiles match
+  Mandelbrot colourer(width, height, 1, options.tile_size);
+  applyHeadlessOptions(colourer, options);
+  std::vector<Uint32> pixels(shared.counts.size());
+  colourer.colourCounts(shared.counts, pixels);
+
+  if (!writeImage(pixels, width, height, options.output_path)) {
+    return 1;
+  }
+
+  std::cout << "Wrote out " << options.output_path << std::endl;
+
+  return 0;
+}
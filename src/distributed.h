@@ -0,0 +1,37 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "headless.h"
+#include <string>
+#include <vector>
+
+/** Where a worker process listens */
+struct WorkerAddress {
+  std::string host;
+  unsigned short port;
+};
+
+/** Parse a comma-separated list of host:port (or just port, for localhost)
+ * worker addresses. Returns false if any of them doesn't parse.
+ */
+bool parseWorkerAddresses(std::string const &text,
+                          std::vector<WorkerAddress> &workers);
+
+/** Serve tiles to coordinators on a TCP port, one coordinator at a time,
+ * until the process is killed. Tiles are rendered with the render thread
+ * pool, kernel and tile size in options; the view comes with the tiles.
+ * Returns a process exit code if the port can't be listened on.
+ */
+int runWorker(HeadlessOptions const &options, unsigned short port);
+
+/** Render one frame by cutting it into tiles and dealing them out to worker
+ * processes, which send back the iteration counts of each; the frame is then
+ * coloured here and written to options.output_path. Tiles of workers that
+ * drop out (or stop answering) are handed to the others. Reports aggregate
+ * and per-worker throughput on stdout.
+ * Returns a process exit code.
+ */
+int runCoordinator(HeadlessOptions const &options,
+                   std::vector<WorkerAddress> const &workers);
+
+#endif
@@ -0,0 +1,64 @@
+#include "fractal.h"
+#include <sstream>
+
+bool Fractal::operator==(Fractal const &other) const {
+  // The constant only matters to Julia sets
+  return formula == other.formula && power == other.power &&
+         (formula != Formula::Julia || (c_r == other.c_r && c_i == other.c_i));
+}
+
+std::string formulaName(Formula formula) {
+  switch (formula) {
+  case Formula::Julia:
+    return "julia";
+  case Formula::BurningShip:
+    return "burning-ship";
+  default:
+    return "mandelbrot";
+  }
+}
+
+bool parseFormula(std::string const &name, Formula &formula) {
+  for (Formula candidate :
+       {Formula::Mandelbrot, Formula::Julia, Formula::BurningShip}) {
+    if (formulaName(candidate) == name) {
+      formula = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string describeFractal(Fractal const &fractal) {
+  std::ostringstream text;
+  switch (fractal.formula) {
+  case Formula::Julia:
+    text << "z^" << fractal.power << " + c Julia set, c = " << fractal.c_r
+         << (fractal.c_i < 0 ? " - " : " + ")
+         << (fractal.c_i < 0 ? -fractal.c_i : fractal.c_i) << "i";
+    break;
+  case Formula::BurningShip:
+    text << "(|Re z| + i|Im z|)^" << fractal.power << " + c Burning Ship";
+    break;
+  default:
+    text << "z^" << fractal.power << " + c "
+         << (fractal.power == 2 ? "Mandelbrot set" : "Multibrot");
+    break;
+  }
+  return text.str();
+}
+
+void defaultCenter(Fractal const &fractal, double &x, double &y) {
+  if (fractal.isMandelbrot()) {
+    x = -1.0;
+    y = 0.0;
+  } else if (fractal.formula == Formula::BurningShip) {
+    // The ship lies at negative imaginary parts, which are at the top of
+    // the screen
+    x = -0.5;
+    y = -0.5;
+  } else {
+    x = 0.0;
+    y = 0.0;
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef FRACTAL_H
+#define FRACTAL_H
+
+#include <string>
+
+/** The escape-time formulas the kernels iterate, each as
+ * z -> f(z)^power + c. Mandelbrot and Burning Ship start every pixel at
+ * z = 0 with c at the pixel; Burning Ship folds z into the first quadrant,
+ * f(z) = |Re z| + i|Im z|, before raising it to the power. Julia sets start z
+ * at the pixel and share one c.
+ */
+enum class Formula { Mandelbrot, Julia, BurningShip };
+
+/* Powers of z the kernels are compiled for; z^2 + c with the Mandelbrot
+ * formula is the Mandelbrot set, higher powers are Multibrots */
+constexpr unsigned int MIN_POWER = 2;
+constexpr unsigned int MAX_POWER = 8;
+
+/** A fractal family and its parameters */
+struct Fractal {
+  Formula formula{Formula::Mandelbrot};
+  unsigned int power{2};
+  /* The constant c of a Julia set */
+  double c_r{-0.8};
+  double c_i{0.156};
+
+  bool operator==(Fractal const &other) const;
+  bool operator!=(Fractal const &other) const { return !(*this == other); }
+
+  // true for z^2 + c from z = 0, the only family with perturbation, the
+  // cardioid test and reference orbits
+  bool isMandelbrot() const {
+    return formula == Formula::Mandelbrot && power == 2;
+  }
+  // true if the points at c and conj(c) have mirrored orbits, so that rows
+  // can be mirrored across the real axis
+  bool hasRealSymmetry() const { return formula == Formula::Mandelbrot; }
+};
+
+std::string formulaName(Formula formula);
+// Looks up a formula by name; returns false if there is no such formula
+bool parseFormula(std::string const &name, Formula &formula);
+
+/** Describes the fractal for the console, such as "z^3 + c Multibrot" */
+std::string describeFractal(Fractal const &fractal);
+
+/** Center of the view that shows the whole of the fractal at zoom 1 */
+void defaultCenter(Fractal const &fractal, double &x, double &y);
+
+#endif
@@ -0,0 +1,271 @@
+#include "headless.h"
+#include "mandelbrot.h"
+#include "png_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+/* Strips coloured by histogram are equalised with a preview of the whole
+ * image at most this many pixels across */
+constexpr unsigned int PREVIEW_SIZE = 1024;
+
+bool writeImage(std::vector<Uint32> &pixels, unsigned int width,
+                unsigned int height, std::string const &path) {
+  // Surfaces don't need SDL_Init, so this works without a display
+  SDL_Surface *image = SDL_CreateRGBSurfaceFrom(
+      &pixels[0], width, height, 32, width * sizeof(Uint32), 0x00ff0000,
+      0x0000ff00, 0x000000ff, 0xff000000);
+
+  if (image == nullptr) {
+    std::cerr << "Image surface could not be created." << std::endl;
+    std::cerr << "SDL_Error: " << SDL_GetError() << std::endl;
+    return false;
+  }
+
+  bool ok = SDL_SaveBMP(image, path.c_str()) == 0;
+  SDL_FreeSurface(image);
+
+  if (!ok) {
+    std::cerr << "Could not write " << path << std::endl;
+    std::cerr << "SDL_Error: " << SDL_GetError() << std::endl;
+  }
+
+  return ok;
+}
+
+void applyHeadlessOptions(Mandelbrot &mandelbrot,
+                          HeadlessOptions const &options) {
+  // Start from the default view, whatever was set before
+  mandelbrot.resetBounds();
+  if (options.placement.threadCount() > 0) {
+    mandelbrot.setPlacement(options.placement);
+  }
+  mandelbrot.setFractal(options.fractal);
+  if (options.use_bounds) {
+    mandelbrot.setBounds(options.x_min, options.x_max, options.y_min,
+                         options.y_max);
+  } else {
+    mandelbrot.setCenter(options.center_x, options.center_y);
+    mandelbrot.setZoom(options.zoom);
+  }
+  mandelbrot.setIterations(options.max_iterations);
+  mandelbrot.setColourScheme(options.colour_scheme);
+  mandelbrot.setColouring(options.colouring);
+  mandelbrot.setKernel(options.kernel);
+  mandelbrot.setPrecision(options.precision);
+  mandelbrot.setShortcuts(options.shortcuts);
+  mandelbrot.setRenderMode(options.mode);
+  mandelbrot.setAntialias(options.antialias);
+  // A single frame never gets its iteration limit raised
+  mandelbrot.setResumeMemory(0);
+  // ...nor revisits a view
+  mandelbrot.setCacheMemory(0);
+}
+
+int runHeadless(HeadlessOptions const &options) {
+  Mandelbrot mandelbrot(options.screen_width, options.screen_height,
+                        options.thread_count, options.tile_size);
+  applyHeadlessOptions(mandelbrot, options);
+
+  std::vector<Uint32> pixels(options.screen_width * options.screen_height, 0);
+
+  auto start = std::chrono::steady_clock::now();
+  mandelbrot.renderFrame(pixels);
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double mpixels = (double)pixels.size() / 1e6;
+
+  std::cout << "Rendered " << options.screen_width << "x"
+            << options.screen_height << " at " << options.max_iterations
+            << " iterations on " << options.thread_count << " threads ("
+            << kernelName(options.kernel) << " kernel, "
+            << mandelbrot.arithmetic() << ", " << renderModeName(options.mode)
+            << ")" << std::endl;
+  if (std::shared_ptr<DeepView const> deep = mandelbrot.deepView()) {
+    std::cout << "Deep zoom: perturbation around a "
+              << 64 * deep->fraction_limbs << "-bit reference orbit of "
+              << deep->reference->zr.size() - 1 << " iterations, "
+              << deep->reference->skipped
+              << " skipped by series approximation, " << deep->rebased_orbits
+              << " more orbits for glitched pixels" << std::endl;
+    std::cout << "Glitched pixels: " << deep->fallback_pixels
+              << " iterated in double-double, " << deep->unresolved_pixels
+              << " left unresolved" << std::endl;
+  }
+  if (options.antialias >= 2) {
+    unsigned long refined = mandelbrot.antialiasedPixels();
+    std::cout << "Anti-aliasing: " << refined << " pixels ("
+              << 100.0 * refined / pixels.size() << "%) supersampled "
+              << options.antialias << "x" << options.antialias << std::endl;
+  }
+  std::cout << "Wall time: " << seconds * 1000.0 << " ms" << std::endl;
+  std::cout << "Throughput: " << mpixels / seconds << " Mpixels/s"
+            << std::endl;
+
+  // Utilisation is the share of the wall time each render thread spent
+  // computing tiles rather than waiting for them
+  std::vector<WorkerStats> stats = mandelbrot.workerStats();
+  double total_busy = 0.0;
+
+  for (unsigned int i = 0; i < stats.size(); i++) {
+    total_busy += stats[i].busy_seconds;
+    std::cout << "Thread " << i << ": "
+              << 100.0 * stats[i].busy_seconds / seconds << "% busy, "
+              << stats[i].jobs << " tiles (" << stats[i].steals << " stolen)";
+    if (i < options.placement.threadCount() &&
+        options.placement.worker_cpus[i] >= 0) {
+      std::cout << " on CPU " << options.placement.worker_cpus[i];
+    }
+    std::cout << std::endl;
+  }
+
+  if (!stats.empty()) {
+    std::cout << "Utilisation: "
+              << 100.0 * total_busy / (seconds * stats.size()) << "% over "
+              << stats.size() << " threads (" << options.tile_size
+              << "px tiles)" << std::endl;
+  }
+
+  if (!writeImage(pixels, options.screen_width, options.screen_height,
+                  options.output_path)) {
+    return 1;
+  }
+
+  std::cout << "Wrote out " << options.output_path << std::endl;
+
+  return 0;
+}
+
+/** Histogram of the counts of the whole image, from a preview at most
+ * PREVIEW_SIZE pixels across rendered with the same view, for every strip to
+ * be equalised with
+ */
+std::vector<unsigned int> previewHistogram(HeadlessOptions const &options) {
+  unsigned int scale =
+      std::max({1u, (options.screen_width + PREVIEW_SIZE - 1) / PREVIEW_SIZE,
+                (options.screen_height + PREVIEW_SIZE - 1) / PREVIEW_SIZE});
+  unsigned int width = std::max(1u, options.screen_width / scale);
+  unsigned int height = std::max(1u, options.screen_height / scale);
+
+  Mandelbrot preview(width, height, options.thread_count, options.tile_size);
+  applyHeadlessOptions(preview, options);
+  preview.setAntialias(0);
+
+  std::cout << "Equalising colours with a " << width << "x" << height
+            << " preview" << std::endl;
+  std::vector<Uint32> pixels((size_t)width * height);
+  preview.renderFrame(pixels);
+  return preview.colourHistogram();
+}
+
+int runStrips(HeadlessOptions const &options) {
+  unsigned int width = options.screen_width;
+  unsigned int height = options.screen_height;
+  unsigned int strip_height = std::min(options.strip_height, height);
+  unsigned int strips = (height + strip_height - 1) / strip_height;
+
+  PngWriter writer;
+  if (!writer.open(options.output_path, width, height)) {
+    return 1;
+  }
+
+  std::cout << "Rendering " << width << "x" << height << " at "
+            << options.max_iterations << " iterations on "
+            << options.thread_count << " threads in " << strips
+            << " strips of " << strip_height << " rows ("
+            << kernelName(options.kernel) << " kernel, "
+            << renderModeName(options.mode) << ")" << std::endl;
+
+  // Strips equalised by their own counts would each be coloured differently,
+  // so they share the histogram of a preview of the whole image
+  std::vector<unsigned int> histogram;
+  if (options.colouring == Colouring::Histogram) {
+    histogram = previewHistogram(options);
+  }
+
+  // One strip is compressed and written out while the next is rendered, so
+  // two strips of pixels (and one of iteration counts) are all that is held
+  std::vector<Uint32> buffers[2];
+  std::future<bool> written;
+  std::unique_ptr<Mandelbrot> mandelbrot;
+  double render_seconds = 0.0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int k = 0; k < strips; k++) {
+    unsigned int y0 = k * strip_height;
+    unsigned int rows = std::min(strip_height, height - y0);
+
+    // The last strip may be shorter, and needs a frame of its own size
+    if (!mandelbrot || rows != strip_height) {
+      mandelbrot = std::make_unique<Mandelbrot>(
+          width, rows, options.thread_count, options.tile_size);
+    }
+    applyHeadlessOptions(*mandelbrot, options);
+    mandelbrot->cropTo(width, height, 0, y0);
+    if (!histogram.empty()) {
+      mandelbrot->setColourHistogram(histogram);
+    }
+
+    std::vector<Uint32> &pixels = buffers[k % 2];
+    pixels.resize((size_t)width * rows);
+
+    auto render_start = std::chrono::steady_clock::now();
+    mandelbrot->renderFrame(pixels);
+    render_seconds += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - render_start)
+                          .count();
+
+    if (written.valid() && !written.get()) {
+      break;
+    }
+    written = std::async(std::launch::async, [&writer, &pixels, rows] {
+      return writer.writeRows(&pixels[0], rows);
+    });
+
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    double done = (double)(y0 + rows) / height;
+    std::streamsize precision = std::cout.precision();
+    std::cout << "\rStrip " << k + 1 << "/" << strips << " ("
+              << std::fixed << std::setprecision(1) << 100.0 * done
+              << "%), " << (double)width * (y0 + rows) / 1e6 / seconds
+              << " Mpixels/s, " << seconds * (1.0 - done) / done
+              << " s left    " << std::defaultfloat
+              << std::setprecision(precision) << std::flush;
+  }
+  std::cout << std::endl;
+  if (mandelbrot) {
+    std::cout << "Iterated in " << mandelbrot->arithmetic() << std::endl;
+  }
+
+  bool ok = (!written.valid() || written.get()) && writer.finish();
+  if (!ok) {
+    std::cerr << "Could not write " << options.output_path << std::endl;
+    return 1;
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double mpixels = (double)width * height / 1e6;
+
+  std::cout << "Wall time: " << seconds << " s (rendering "
+            << render_seconds << " s)" << std::endl;
+  std::cout << "Throughput: " << mpixels / seconds << " Mpixels/s"
+            << std::endl;
+  std::cout << "Strip buffers: "
+            << 3 * sizeof(Uint32) * width * strip_height / 1e6
+            << " MB for pixels and iteration counts" << std::endl;
+  std::cout << "Wrote out " << options.output_path << " ("
+            << writer.bytesWritten() / 1e6 << " MB, "
+            << 3.0 * width * height / writer.bytesWritten()
+            << "x smaller than raw RGB)" << std::endl;
+
+  return 0;
+}
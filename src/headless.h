@@ -0,0 +1,72 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "SDL.h"
+#include "big_float.h"
+#include "kernels.h"
+#include "mandelbrot.h"
+#include "topology.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+/** Everything needed to render a single frame without opening a window.
+ * The viewport is given either as a center and zoom (as in the interactive
+ * viewer) or, when use_bounds is set, as explicit bounds on the complex plane.
+ */
+struct HeadlessOptions {
+  unsigned int screen_width{800};
+  unsigned int screen_height{600};
+  unsigned int thread_count{1};
+  /* Where the render threads run, if not left to the OS */
+  ThreadPlacement placement;
+  unsigned int tile_size{32};
+  /* Viewport as center/zoom; the center keeps every digit it is given */
+  BigFloat center_x{-1.0};
+  BigFloat center_y{0.0};
+  double zoom{1.0};
+  /* Viewport as explicit bounds */
+  bool use_bounds{false};
+  double x_min{-2.5};
+  double x_max{0.5};
+  double y_min{-1.25};
+  double y_max{1.25};
+  unsigned int max_iterations{50};
+  unsigned int colour_scheme{0};
+  Colouring colouring{Colouring::Linear};
+  Fractal fractal;
+  KernelType kernel{KernelType::Scalar};
+  /* Number format to iterate in, if not picked for each frame */
+  std::optional<Precision> precision;
+  Shortcuts shortcuts;
+  RenderMode mode{RenderMode::BruteForce};
+  /* Supersampling grid for edge pixels (0 for no anti-aliasing) */
+  unsigned int antialias{0};
+  std::string output_path{"mandelbrot.bmp"};
+  /* If nonzero, render in strips of this many rows, streaming each to a PNG
+     as it is finished, so that memory doesn't grow with the image */
+  unsigned int strip_height{0};
+};
+
+/** Set the view and render parameters of the options up on mandelbrot */
+void applyHeadlessOptions(Mandelbrot &mandelbrot,
+                          HeadlessOptions const &options);
+
+/** Render one frame with the render thread pool into a plain buffer, write it
+ * to options.output_path and report timings on stdout.
+ * Returns a process exit code.
+ */
+int runHeadless(HeadlessOptions const &options);
+
+/** Render an image of any size strip by strip with the render thread pool,
+ * writing each strip to a PNG at options.output_path while the next one is
+ * computed, and report progress and throughput on stdout.
+ * Returns a process exit code.
+ */
+int runStrips(HeadlessOptions const &options);
+
+/** Write ARGB pixel data out as an image file */
+bool writeImage(std::vector<Uint32> &pixels, unsigned int width,
+                unsigned int height, std::string const &path);
+
+#endif
@@ -13,6 +13,13 @@ void Input::handleInput(Mandelbrot &instance, Renderer &renderer) const {
       instance.stop();
       break;
     }
+    case SDL_WINDOWEVENT: {
+      // The window contents may have been lost while it was covered
+      if (e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+        renderer.requestPresent();
+      }
+      break;
+    }
     case SDL_MOUSEBUTTONDOWN: {
       if (e.button.button == SDL_BUTTON_LEFT) {
         instance.onMouseDown(e.button.x, e.button.y);
@@ -84,6 +91,14 @@ void Input::handleInput(Mandelbrot &instance, Renderer &renderer) const {
         instance.nextColourScheme();
         break;
       }
+      case SDLK_h: {
+        instance.toggleColouring();
+        break;
+      }
+      case SDLK_j: {
+        instance.toggleJulia();
+        break;
+      }
       }
       break;
     }
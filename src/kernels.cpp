@@ -0,0 +1,182 @@
+#include "kernels.h"
+#include "simd_kernel.h"
+
+namespace {
+/* A "vector" of one double, so the scalar kernel shares the generic loop */
+struct ScalarDouble {
+  using scalar = double;
+  using reg = double;
+  using mask = bool;
+  static constexpr unsigned int lanes = 1;
+
+  static reg set1(double v) { return v; }
+  static reg load(double const *in) { return in[0]; }
+  static reg ramp() { return 0.0; }
+  static reg add(reg a, reg b) { return a + b; }
+  static reg sub(reg a, reg b) { return a - b; }
+  static reg mul(reg a, reg b) { return a * b; }
+  static reg abs(reg a) { return std::fabs(a); }
+  static reg negateWhere(reg a, mask m) { return m ? -a : a; }
+  static mask all() { return true; }
+  static mask none() { return false; }
+  static mask greaterEqual(reg a, reg b) { return a >= b; }
+  static mask lessEqual(reg a, reg b) { return a <= b; }
+  static mask andMask(mask a, mask b) { return a && b; }
+  static mask orMask(mask a, mask b) { return a || b; }
+  static mask andNot(mask a, mask b) { return a && !b; }
+  static bool any(mask m) { return m; }
+  static unsigned int bits(mask m) { return m ? 1 : 0; }
+  static reg increment(reg count, mask m) { return m ? count + 1.0 : count; }
+  static void store(double *out, reg v) { out[0] = v; }
+};
+
+/* And of one float */
+struct ScalarFloat {
+  using scalar = float;
+  using reg = float;
+  using mask = bool;
+  static constexpr unsigned int lanes = 1;
+
+  static reg set1(double v) { return v; }
+  static reg load(float const *in) { return in[0]; }
+  static reg ramp() { return 0.0f; }
+  static reg add(reg a, reg b) { return a + b; }
+  static reg sub(reg a, reg b) { return a - b; }
+  static reg mul(reg a, reg b) { return a * b; }
+  static reg abs(reg a) { return std::fabs(a); }
+  static mask all() { return true; }
+  static mask none() { return false; }
+  static mask greaterEqual(reg a, reg b) { return a >= b; }
+  static mask lessEqual(reg a, reg b) { return a <= b; }
+  static mask andMask(mask a, mask b) { return a && b; }
+  static mask orMask(mask a, mask b) { return a || b; }
+  static mask andNot(mask a, mask b) { return a && !b; }
+  static bool any(mask m) { return m; }
+  static unsigned int bits(mask m) { return m ? 1 : 0; }
+  static reg increment(reg count, mask m) { return m ? count + 1.0f : count; }
+  static void store(float *out, reg v) { out[0] = v; }
+};
+} // namespace
+
+RowKernel rowKernelScalar(Formula formula, unsigned int power,
+                          Precision precision) {
+  return rowKernel<ScalarFloat, ScalarDouble>(formula, power, precision);
+}
+
+void iteratePerturbedRowScalar(PerturbationRow const &row,
+                               unsigned int *iterations) {
+  iteratePerturbedRowVector<ScalarDouble>(row, iterations);
+}
+
+bool kernelSupported(KernelType type) {
+  switch (type) {
+  case KernelType::Scalar:
+    return true;
+#if defined(__x86_64__) || defined(__i386__)
+  case KernelType::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case KernelType::AVX2:
+    return __builtin_cpu_supports("avx2");
+  case KernelType::AVX512:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+KernelType detectKernel() {
+  for (KernelType type :
+       {KernelType::AVX512, KernelType::AVX2, KernelType::SSE2}) {
+    if (kernelSupported(type)) {
+      return type;
+    }
+  }
+  return KernelType::Scalar;
+}
+
+RowKernel getKernel(KernelType type, Fractal const &fractal,
+                    Precision precision) {
+  unsigned int power = std::min(std::max(fractal.power, MIN_POWER), MAX_POWER);
+
+  switch (type) {
+  case KernelType::SSE2:
+    return rowKernelSSE2(fractal.formula, power, precision);
+  case KernelType::AVX2:
+    return rowKernelAVX2(fractal.formula, power, precision);
+  case KernelType::AVX512:
+    return rowKernelAVX512(fractal.formula, power, precision);
+  default:
+    return rowKernelScalar(fractal.formula, power, precision);
+  }
+}
+
+PerturbationKernel getPerturbationKernel(KernelType type) {
+  switch (type) {
+  case KernelType::SSE2:
+    return &iteratePerturbedRowSSE2;
+  case KernelType::AVX2:
+    return &iteratePerturbedRowAVX2;
+  case KernelType::AVX512:
+    return &iteratePerturbedRowAVX512;
+  default:
+    return &iteratePerturbedRowScalar;
+  }
+}
+
+Precision precisionFor(double pixel_spacing, unsigned int max_iterations) {
+  if (pixel_spacing >= FLOAT_PIXEL_SPACING &&
+      max_iterations < FLOAT_MAX_ITERATIONS) {
+    return Precision::Float;
+  }
+  if (pixel_spacing >= DOUBLE_PIXEL_SPACING) {
+    return Precision::Double;
+  }
+  return Precision::DoubleDouble;
+}
+
+std::string precisionName(Precision precision) {
+  switch (precision) {
+  case Precision::Float:
+    return "float";
+  case Precision::DoubleDouble:
+    return "double-double";
+  default:
+    return "double";
+  }
+}
+
+bool parsePrecision(std::string const &name, Precision &precision) {
+  for (Precision candidate :
+       {Precision::Float, Precision::Double, Precision::DoubleDouble}) {
+    if (precisionName(candidate) == name) {
+      precision = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string kernelName(KernelType type) {
+  switch (type) {
+  case KernelType::SSE2:
+    return "sse2";
+  case KernelType::AVX2:
+    return "avx2";
+  case KernelType::AVX512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
+
+bool parseKernelName(std::string const &name, KernelType &type) {
+  for (KernelType candidate : {KernelType::Scalar, KernelType::SSE2,
+                               KernelType::AVX2, KernelType::AVX512}) {
+    if (kernelName(candidate) == name) {
+      type = candidate;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,151 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "fractal.h"
+#include <string>
+
+/** A RowParams object describes a run of pixels along one row for a kernel.
+ * Pixel i of the run sits at (x0 + (first + i * stride) * dx) + y*i on
+ * the complex plane, so a run computes exactly the same points as the full
+ * row would. If ys is set, pixel i has imaginary part ys[i] instead of y; a
+ * stride of 0 then makes the run a column. If xs is set too, pixel i has real
+ * part xs[i], and the run can be any set of points.
+ *
+ * Double-double kernels add x0_lo to x0 and y_lo to y, for views too deep
+ * for a double to place their pixels; xs and ys are only doubles.
+ */
+struct RowParams {
+  double x0;                 /* real part of the row's leftmost pixel */
+  double dx;                 /* distance between neighbouring pixels */
+  double y;                  /* imaginary part of the whole row */
+  double x0_lo{0.0};         /* low part of x0, for double-double kernels */
+  double y_lo{0.0};          /* low part of y, for double-double kernels */
+  double const *ys{nullptr}; /* imaginary part of each pixel, if set */
+  double const *xs{nullptr}; /* real part of each pixel, if set (with ys) */
+  unsigned int first;        /* index of the run's first pixel in the row */
+  unsigned int stride;       /* distance between pixels of the run, in pixels */
+  unsigned int width;        /* number of pixels in the run */
+  unsigned int max_iterations;
+  /* The constant c of a Julia set, whose pixels are starting points of z */
+  double c_r{0.0};
+  double c_i{0.0};
+  /* Shortcuts for interior points, which otherwise run to max_iterations
+     (the cardioid test only applies to z^2 + c, and other kernels skip it) */
+  bool cardioid_check;    /* analytic main cardioid / period-2 bulb test */
+  bool periodicity_check; /* Brent-style cycle detection */
+  /* Resumable orbits: if set, pixels still running at max_iterations leave
+     their z in orbit_r[i], orbit_i[i] (NaN if found to be inside the set),
+     and with a nonzero start_iteration every pixel starts from the z stored
+     there instead of from 0 */
+  double *orbit_r{nullptr};
+  double *orbit_i{nullptr};
+  unsigned int start_iteration{0};
+};
+
+/** A row kernel computes escape-time iteration counts of one fractal family
+ * for a row of pixels. The count for pixel i is written to iterations[i]
+ * (max_iterations for points that never escape).
+ */
+using RowKernel = void (*)(RowParams const &row, unsigned int *iterations);
+
+/** A PerturbationRow describes a run of pixels for a perturbation kernel.
+ * Each pixel is iterated as a delta from a precomputed reference orbit
+ * Z_0..Z_{reference_length-1}, so that only the reference needs more
+ * precision than a double. Pixel i has c = C + dc with
+ * dc = (dc_x0 + (first + i * stride) * dx) + dc_y*i, where C is the
+ * reference point.
+ *
+ * The first `skipped` iterations are replaced by the series approximation
+ * dz = a*dc + b*dc^2 + c*dc^3.
+ */
+struct PerturbationRow {
+  double const *reference_r;
+  double const *reference_i;
+  unsigned int reference_length;
+  unsigned int skipped;
+  double a_r, a_i, b_r, b_i, c_r, c_i;
+  double dc_x0;
+  double dx;
+  double dc_y;
+  unsigned int first;
+  unsigned int stride;
+  unsigned int width;
+  unsigned int max_iterations;
+};
+
+/* Iteration count written for pixels whose delta became unreliable, either
+ * because |Z + dz| got too small compared to |Z| or because the pixel
+ * outlived the reference orbit. They need iterating around a new reference. */
+constexpr unsigned int GLITCHED_PIXEL = 0xffffffff;
+
+using PerturbationKernel = void (*)(PerturbationRow const &row,
+                                    unsigned int *iterations);
+
+/** Number formats the row kernels iterate in, from fastest to most precise.
+ * Float fills twice the lanes of a double in every vector register;
+ * double-double keeps each value as an unevaluated sum of two doubles, good
+ * for about 106 bits, at roughly a tenth of the speed of a double.
+ */
+enum class Precision { Float, Double, DoubleDouble };
+
+/* Smallest pixel spacing each format resolves, in views of the fractals (all
+ * within |c| <= 2): about two thousand units in the last place of a
+ * coordinate, the margin a double has always had at DEEP_ZOOM_PIXEL_SPACING.
+ * Past the last, double-double runs out of precision too. */
+constexpr double FLOAT_PIXEL_SPACING = 5e-4;
+constexpr double DOUBLE_PIXEL_SPACING = 1e-12;
+constexpr double DOUBLE_DOUBLE_PIXEL_SPACING = 1e-28;
+
+/* Float kernels count iterations in floats, which are exact up to 2^24 */
+constexpr unsigned int FLOAT_MAX_ITERATIONS = 1u << 24;
+
+// The fastest precision that resolves pixels pixel_spacing apart and counts
+// up to max_iterations
+Precision precisionFor(double pixel_spacing, unsigned int max_iterations);
+
+std::string precisionName(Precision precision);
+// Parses a precision name as given on the command line; false if unknown
+bool parsePrecision(std::string const &name, Precision &precision);
+
+/** The available implementations of the escape-time loop, from slowest to
+ * fastest. The vector kernels iterate several pixels at once with per-lane
+ * escape masks.
+ */
+enum class KernelType { Scalar, SSE2, AVX2, AVX512 };
+
+// Whether the running CPU (and OS) supports the given kernel
+bool kernelSupported(KernelType type);
+// The fastest kernel the running CPU supports, as reported by CPUID
+KernelType detectKernel();
+// Function pointer for the given kernel (must be supported), compiled for the
+// fractal's formula and power and iterating in the given precision
+RowKernel getKernel(KernelType type, Fractal const &fractal = Fractal(),
+                    Precision precision = Precision::Double);
+PerturbationKernel getPerturbationKernel(KernelType type);
+
+std::string kernelName(KernelType type);
+// Parses a kernel name as given on the command line; false if unknown
+bool parseKernelName(std::string const &name, KernelType &type);
+
+/* Per-instruction-set kernels, defined in their own translation units so
+ * that each can be compiled with the matching -m flags. The row kernels are
+ * looked up by formula, power (MIN_POWER to MAX_POWER) and precision. */
+RowKernel rowKernelScalar(Formula formula, unsigned int power,
+                          Precision precision);
+RowKernel rowKernelSSE2(Formula formula, unsigned int power,
+                        Precision precision);
+RowKernel rowKernelAVX2(Formula formula, unsigned int power,
+                        Precision precision);
+RowKernel rowKernelAVX512(Formula formula, unsigned int power,
+                          Precision precision);
+
+void iteratePerturbedRowScalar(PerturbationRow const &row,
+                               unsigned int *iterations);
+void iteratePerturbedRowSSE2(PerturbationRow const &row,
+                             unsigned int *iterations);
+void iteratePerturbedRowAVX2(PerturbationRow const &row,
+                             unsigned int *iterations);
+void iteratePerturbedRowAVX512(PerturbationRow const &row,
+                               unsigned int *iterations);
+
+#endif
@@ -0,0 +1,101 @@
+#include "kernels.h"
+
+#if defined(__AVX2__)
+#include "simd_kernel.h"
+#include <immintrin.h>
+
+namespace {
+struct AVX2Double {
+  using scalar = double;
+  using reg = __m256d;
+  using mask = __m256d;
+  static constexpr unsigned int lanes = 4;
+
+  static reg set1(double v) { return _mm256_set1_pd(v); }
+  static reg load(double const *in) { return _mm256_loadu_pd(in); }
+  static reg ramp() { return _mm256_set_pd(3.0, 2.0, 1.0, 0.0); }
+  static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+  static reg abs(reg a) {
+    return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+  }
+  static reg negateWhere(reg a, mask m) {
+    return _mm256_xor_pd(a, _mm256_and_pd(m, _mm256_set1_pd(-0.0)));
+  }
+  static mask all() { return _mm256_castsi256_pd(_mm256_set1_epi32(-1)); }
+  static mask none() { return _mm256_setzero_pd(); }
+  static mask greaterEqual(reg a, reg b) {
+    return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+  }
+  static mask lessEqual(reg a, reg b) {
+    return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+  }
+  static mask andMask(mask a, mask b) { return _mm256_and_pd(a, b); }
+  static mask orMask(mask a, mask b) { return _mm256_or_pd(a, b); }
+  static mask andNot(mask a, mask b) { return _mm256_andnot_pd(b, a); }
+  static bool any(mask m) { return _mm256_movemask_pd(m) != 0; }
+  static unsigned int bits(mask m) { return _mm256_movemask_pd(m); }
+  static reg increment(reg count, mask m) {
+    return _mm256_add_pd(count, _mm256_and_pd(m, _mm256_set1_pd(1.0)));
+  }
+  static void store(double *out, reg v) { _mm256_storeu_pd(out, v); }
+};
+
+struct AVX2Float {
+  using scalar = float;
+  using reg = __m256;
+  using mask = __m256;
+  static constexpr unsigned int lanes = 8;
+
+  static reg set1(double v) { return _mm256_set1_ps(v); }
+  static reg load(float const *in) { return _mm256_loadu_ps(in); }
+  static reg ramp() {
+    return _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+  }
+  static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static reg abs(reg a) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+  }
+  static mask all() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+  static mask none() { return _mm256_setzero_ps(); }
+  static mask greaterEqual(reg a, reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+  }
+  static mask lessEqual(reg a, reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+  }
+  static mask andMask(mask a, mask b) { return _mm256_and_ps(a, b); }
+  static mask orMask(mask a, mask b) { return _mm256_or_ps(a, b); }
+  static mask andNot(mask a, mask b) { return _mm256_andnot_ps(b, a); }
+  static bool any(mask m) { return _mm256_movemask_ps(m) != 0; }
+  static unsigned int bits(mask m) { return _mm256_movemask_ps(m); }
+  static reg increment(reg count, mask m) {
+    return _mm256_add_ps(count, _mm256_and_ps(m, _mm256_set1_ps(1.0f)));
+  }
+  static void store(float *out, reg v) { _mm256_storeu_ps(out, v); }
+};
+} // namespace
+
+RowKernel rowKernelAVX2(Formula formula, unsigned int power,
+                        Precision precision) {
+  return rowKernel<AVX2Float, AVX2Double>(formula, power, precision);
+}
+
+void iteratePerturbedRowAVX2(PerturbationRow const &row,
+                             unsigned int *iterations) {
+  iteratePerturbedRowVector<AVX2Double>(row, iterations);
+}
+#else
+RowKernel rowKernelAVX2(Formula formula, unsigned int power,
+                        Precision precision) {
+  return rowKernelScalar(formula, power, precision);
+}
+
+void iteratePerturbedRowAVX2(PerturbationRow const &row,
+                             unsigned int *iterations) {
+  iteratePerturbedRowScalar(row, iterations);
+}
+#endif
@@ -0,0 +1,100 @@
+#include "kernels.h"
+
+#if defined(__AVX512F__)
+#include "simd_kernel.h"
+#include <immintrin.h>
+
+namespace {
+struct AVX512Double {
+  using scalar = double;
+  using reg = __m512d;
+  using mask = __mmask8;
+  static constexpr unsigned int lanes = 8;
+
+  static reg set1(double v) { return _mm512_set1_pd(v); }
+  static reg load(double const *in) { return _mm512_loadu_pd(in); }
+  static reg ramp() {
+    return _mm512_set_pd(7.0, 6.0, 5.0, 4.0, 3.0, 2.0, 1.0, 0.0);
+  }
+  static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+  static reg abs(reg a) { return _mm512_abs_pd(a); }
+  static reg negateWhere(reg a, mask m) {
+    return _mm512_mask_sub_pd(a, m, _mm512_setzero_pd(), a);
+  }
+  static mask all() { return 0xff; }
+  static mask none() { return 0; }
+  static mask greaterEqual(reg a, reg b) {
+    return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ);
+  }
+  static mask lessEqual(reg a, reg b) {
+    return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ);
+  }
+  static mask andMask(mask a, mask b) { return a & b; }
+  static mask orMask(mask a, mask b) { return a | b; }
+  static mask andNot(mask a, mask b) { return a & ~b; }
+  static bool any(mask m) { return m != 0; }
+  static unsigned int bits(mask m) { return m; }
+  static reg increment(reg count, mask m) {
+    return _mm512_mask_add_pd(count, m, count, _mm512_set1_pd(1.0));
+  }
+  static void store(double *out, reg v) { _mm512_storeu_pd(out, v); }
+};
+
+struct AVX512Float {
+  using scalar = float;
+  using reg = __m512;
+  using mask = __mmask16;
+  static constexpr unsigned int lanes = 16;
+
+  static reg set1(double v) { return _mm512_set1_ps(v); }
+  static reg load(float const *in) { return _mm512_loadu_ps(in); }
+  static reg ramp() {
+    return _mm512_set_ps(15.0f, 14.0f, 13.0f, 12.0f, 11.0f, 10.0f, 9.0f, 8.0f,
+                         7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+  }
+  static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static reg abs(reg a) { return _mm512_abs_ps(a); }
+  static mask all() { return 0xffff; }
+  static mask none() { return 0; }
+  static mask greaterEqual(reg a, reg b) {
+    return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ);
+  }
+  static mask lessEqual(reg a, reg b) {
+    return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ);
+  }
+  static mask andMask(mask a, mask b) { return a & b; }
+  static mask orMask(mask a, mask b) { return a | b; }
+  static mask andNot(mask a, mask b) { return a & ~b; }
+  static bool any(mask m) { return m != 0; }
+  static unsigned int bits(mask m) { return m; }
+  static reg increment(reg count, mask m) {
+    return _mm512_mask_add_ps(count, m, count, _mm512_set1_ps(1.0f));
+  }
+  static void store(float *out, reg v) { _mm512_storeu_ps(out, v); }
+};
+} // namespace
+
+RowKernel rowKernelAVX512(Formula formula, unsigned int power,
+                          Precision precision) {
+  return rowKernel<AVX512Float, AVX512Double>(formula, power, precision);
+}
+
+void iteratePerturbedRowAVX512(PerturbationRow const &row,
+                               unsigned int *iterations) {
+  iteratePerturbedRowVector<AVX512Double>(row, iterations);
+}
+#else
+RowKernel rowKernelAVX512(Formula formula, unsigned int power,
+                          Precision precision) {
+  return rowKernelScalar(formula, power, precision);
+}
+
+void iteratePerturbedRowAVX512(PerturbationRow const &row,
+                               unsigned int *iterations) {
+  iteratePerturbedRowScalar(row, iterations);
+}
+#endif
@@ -0,0 +1,87 @@
+#include "kernels.h"
+
+#if defined(__SSE2__)
+#include "simd_kernel.h"
+#include <immintrin.h>
+
+namespace {
+struct SSE2Double {
+  using scalar = double;
+  using reg = __m128d;
+  using mask = __m128d;
+  static constexpr unsigned int lanes = 2;
+
+  static reg set1(double v) { return _mm_set1_pd(v); }
+  static reg load(double const *in) { return _mm_loadu_pd(in); }
+  static reg ramp() { return _mm_set_pd(1.0, 0.0); }
+  static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+  static reg abs(reg a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+  static reg negateWhere(reg a, mask m) {
+    return _mm_xor_pd(a, _mm_and_pd(m, _mm_set1_pd(-0.0)));
+  }
+  static mask all() { return _mm_castsi128_pd(_mm_set1_epi32(-1)); }
+  static mask none() { return _mm_setzero_pd(); }
+  static mask greaterEqual(reg a, reg b) { return _mm_cmpge_pd(a, b); }
+  static mask lessEqual(reg a, reg b) { return _mm_cmple_pd(a, b); }
+  static mask andMask(mask a, mask b) { return _mm_and_pd(a, b); }
+  static mask orMask(mask a, mask b) { return _mm_or_pd(a, b); }
+  static mask andNot(mask a, mask b) { return _mm_andnot_pd(b, a); }
+  static bool any(mask m) { return _mm_movemask_pd(m) != 0; }
+  static unsigned int bits(mask m) { return _mm_movemask_pd(m); }
+  static reg increment(reg count, mask m) {
+    return _mm_add_pd(count, _mm_and_pd(m, _mm_set1_pd(1.0)));
+  }
+  static void store(double *out, reg v) { _mm_storeu_pd(out, v); }
+};
+
+struct SSE2Float {
+  using scalar = float;
+  using reg = __m128;
+  using mask = __m128;
+  static constexpr unsigned int lanes = 4;
+
+  static reg set1(double v) { return _mm_set1_ps(v); }
+  static reg load(float const *in) { return _mm_loadu_ps(in); }
+  static reg ramp() { return _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f); }
+  static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static reg abs(reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  static mask all() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+  static mask none() { return _mm_setzero_ps(); }
+  static mask greaterEqual(reg a, reg b) { return _mm_cmpge_ps(a, b); }
+  static mask lessEqual(reg a, reg b) { return _mm_cmple_ps(a, b); }
+  static mask andMask(mask a, mask b) { return _mm_and_ps(a, b); }
+  static mask orMask(mask a, mask b) { return _mm_or_ps(a, b); }
+  static mask andNot(mask a, mask b) { return _mm_andnot_ps(b, a); }
+  static bool any(mask m) { return _mm_movemask_ps(m) != 0; }
+  static unsigned int bits(mask m) { return _mm_movemask_ps(m); }
+  static reg increment(reg count, mask m) {
+    return _mm_add_ps(count, _mm_and_ps(m, _mm_set1_ps(1.0f)));
+  }
+  static void store(float *out, reg v) { _mm_storeu_ps(out, v); }
+};
+} // namespace
+
+RowKernel rowKernelSSE2(Formula formula, unsigned int power,
+                        Precision precision) {
+  return rowKernel<SSE2Float, SSE2Double>(formula, power, precision);
+}
+
+void iteratePerturbedRowSSE2(PerturbationRow const &row,
+                             unsigned int *iterations) {
+  iteratePerturbedRowVector<SSE2Double>(row, iterations);
+}
+#else
+RowKernel rowKernelSSE2(Formula formula, unsigned int power,
+                        Precision precision) {
+  return rowKernelScalar(formula, power, precision);
+}
+
+void iteratePerturbedRowSSE2(PerturbationRow const &row,
+                             unsigned int *iterations) {
+  iteratePerturbedRowScalar(row, iterations);
+}
+#endif
@@ -1,7 +1,15 @@
+#include "animation.h"
+#include "distributed.h"
+#include "headless.h"
 #include "input.h"
+#include "kernels.h"
 #include "mandelbrot.h"
 #include "renderer.h"
+#include "topology.h"
+#include "trace.h"
 #include <iostream>
+#include <optional>
+#include <stdexcept>
 
 /**
  * Display the help message if the user provides -h / --help as the first
@@ -14,6 +22,19 @@ void usage() {
             << "\t./Mandelbrot [-h/--help] [--screen-width <px>] "
                "[--screen-height <px>]"
             << std::endl
+            << "\t./Mandelbrot --headless [--center-x <x>] [--center-y <y>] "
+               "[--zoom <z>] [--output <path>]"
+            << std::endl
+            << "\t./Mandelbrot --headless --strip-height <rows> "
+               "[--screen-width <px>] [--screen-height <px>] [--output <path>]"
+            << std::endl
+            << "\t./Mandelbrot --worker <port>" << std::endl
+            << "\t./Mandelbrot --headless --workers <host:port,...> "
+               "[--output <path>]"
+            << std::endl
+            << "\t./Mandelbrot --animate <keyframes> [--frames-per-key <n>] "
+               "[--fps <n>] [--output <path>|-]"
+            << std::endl
             << std::endl
             << "Optional parameters: " << std::endl
             << "\t-h/--help:"
@@ -23,7 +44,122 @@ void usage() {
             << "\t-hx/--screen-height:"
             << " set screen height in pixels (default: 600)" << std::endl
             << "\t-c/--concurrency:"
-            << " set concurrency (-1 to disable) (default: #cpu_cores)"
+            << " set the number of render threads, or where they run as "
+               "[<n>][:pin][:cpus=<list>][:reserve=<cores>] "
+               "(default: #cpu_cores)"
+            << std::endl
+            << "\t--tile-size:"
+            << " set the edge length in pixels of the tiles handed to render "
+               "threads (default: 32)"
+            << std::endl
+            << "\t--kernel:"
+            << " escape-time kernel: auto, scalar, sse2, avx2 or avx512 "
+               "(default: auto, the fastest one this CPU supports)"
+            << std::endl
+            << "\t--precision:"
+            << " number format to iterate in: auto, float, double or "
+               "double-double (default: auto, the fastest that resolves the "
+               "pixels, or perturbation for deep Mandelbrot views)"
+            << std::endl
+            << "\t--fractal:"
+            << " fractal family: mandelbrot, julia or burning-ship (default: "
+               "mandelbrot)"
+            << std::endl
+            << "\t--power:"
+            << " power of z, from 2 to 8; above 2 the mandelbrot family is a "
+               "Multibrot (default: 2)"
+            << std::endl
+            << "\t--julia-re/--julia-im:"
+            << " set the constant c of a Julia set (default: -0.8, 0.156)"
+            << std::endl
+            << "\t--mode:"
+            << " brute-force iterates every pixel, subdivide traces "
+               "rectangle borders and fills uniform ones (default: "
+               "brute-force)"
+            << std::endl
+            << "\t--no-cardioid-check:"
+            << " iterate points in the main cardioid and period-2 bulb"
+            << std::endl
+            << "\t--no-periodicity-check:"
+            << " don't stop orbits early once they settle into a cycle"
+            << std::endl
+            << "\t--no-symmetry:"
+            << " don't mirror rows across the real axis" << std::endl
+            << "\t--resume-memory:"
+            << " megabytes the orbits of pixels that ran out of iterations "
+               "may take, so that more iterations carry on from them (0 to "
+               "disable) (default: 64)"
+            << std::endl
+            << "\t--cache-memory:"
+            << " megabytes finished tiles may take, so that revisited views "
+               "come from the cache (0 to disable) (default: 128)"
+            << std::endl
+            << "\t--trace:"
+            << " record where frame time goes and write it to the given path "
+               "as Chrome trace events, printing a summary of each frame"
+            << std::endl
+            << "\t--antialias:"
+            << " supersample pixels whose iteration count differs sharply "
+               "from a neighbour's on an n x n grid, once the frame is "
+               "complete (0 to disable) (default: 0)"
+            << std::endl
+            << "\t--colouring:"
+            << " linear spreads the colour scheme evenly over the iteration "
+               "counts, histogram over the pixels of each frame, for contrast "
+               "at low iteration limits (default: linear)"
+            << std::endl
+            << "\t--progressive:"
+            << " draw each frame coarse-to-fine, every 8th pixel first"
+            << std::endl
+            << std::endl
+            << "Headless parameters: " << std::endl
+            << "\t--headless:"
+            << " render a single frame to a file without opening a window"
+            << std::endl
+            << "\t--center-x/--center-y:"
+            << " set the center of the view, to any number of digits "
+               "(default: -1.0, 0.0, or the middle of the chosen fractal)"
+            << std::endl
+            << "\t--zoom:"
+            << " set the zoom level, smaller is deeper (default: 1.0)"
+            << std::endl
+            << "\t--x-min/--x-max/--y-min/--y-max:"
+            << " set the view from bounds instead of center/zoom" << std::endl
+            << "\t--iterations:"
+            << " set maximum iterations (default: 50)" << std::endl
+            << "\t--colour-scheme:"
+            << " set colour scheme index (default: 0)" << std::endl
+            << "\t--output:"
+            << " set output path (default: mandelbrot.bmp)" << std::endl
+            << "\t--strip-height:"
+            << " render in strips of this many rows, streaming each to a PNG "
+               "as it is finished, for images bigger than memory (output "
+               "defaults to mandelbrot.png)"
+            << std::endl
+            << std::endl
+            << "Animation parameters: " << std::endl
+            << "\t--animate:"
+            << " render a zoom video through the keyframes in this file, one "
+               "per line as <center-x> <center-y> <zoom> <iterations>"
+            << std::endl
+            << "\t--frames-per-key:"
+            << " set frames from one keyframe to the next (default: 30)"
+            << std::endl
+            << "\t--fps:"
+            << " set the frame rate of y4m output (default: 30)" << std::endl
+            << "\t--output:"
+            << " write a y4m stream to stdout for -, or to a path ending in "
+               ".y4m, and otherwise numbered PNGs <path>-00000.png, ... "
+               "(default: mandelbrot)"
+            << std::endl
+            << std::endl
+            << "Distributed parameters: " << std::endl
+            << "\t--worker:"
+            << " serve tiles to coordinators on this TCP port until killed"
+            << std::endl
+            << "\t--workers:"
+            << " with --headless, deal the frame's tiles out to these worker "
+               "processes (host:port, or just port for localhost)"
             << std::endl;
 }
 
@@ -50,22 +186,318 @@ void setScreenDimensions(unsigned int &screen_width,
 }
 
 /**
- * Sets the maximum concurrency based on user inputs if present.
+ * Sets the number of render threads, and the CPUs they are pinned to, based
+ * on user inputs if present.
  */
-void setConcurrency(unsigned int &max_threads, int argc, char *argv[]) {
-  if (max_threads == 0) {
-    max_threads = 1;
-  }
-
+void setConcurrency(AffinitySpec &spec, int argc, char *argv[]) {
   for (int i = 1; i < argc; i++) {
     if ((std::string(argv[i]) == "--concurrency" ||
          std::string(argv[i]) == "-c") &&
         (i + 1) < argc) {
-      max_threads = std::stoi(argv[i + 1]);
+      spec = parseAffinitySpec(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the render tile size based on user inputs if present.
+ */
+void setTileSize(unsigned int &tile_size, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--tile-size" && (i + 1) < argc) {
+      tile_size = std::stoi(argv[i + 1]);
+    }
+  }
+
+  if (tile_size == 0) {
+    tile_size = 1;
+  }
+}
+
+/**
+ * Sets the escape-time kernel based on user inputs if present. Throws if the
+ * requested kernel is unknown or not supported by this CPU.
+ */
+void setKernelType(KernelType &kernel, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--kernel" && (i + 1) < argc) {
+      std::string name(argv[i + 1]);
+
+      if (name == "auto") {
+        kernel = detectKernel();
+      } else if (!parseKernelName(name, kernel) || !kernelSupported(kernel)) {
+        throw std::invalid_argument(name);
+      }
+    }
+  }
+}
+
+/**
+ * Sets the precision to iterate in based on user inputs if present; none
+ * picks it for each frame. Throws if the requested precision is unknown.
+ */
+void setPrecision(std::optional<Precision> &precision, int argc,
+                  char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--precision" && (i + 1) < argc) {
+      std::string name(argv[i + 1]);
+      Precision parsed;
+
+      if (name == "auto") {
+        precision.reset();
+      } else if (parsePrecision(name, parsed)) {
+        precision = parsed;
+      } else {
+        throw std::invalid_argument(name);
+      }
+    }
+  }
+}
+
+/**
+ * Sets the fractal family, power and Julia constant based on user inputs if
+ * present. Throws if the family is unknown or the power out of range.
+ */
+void setFractal(Fractal &fractal, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+
+    if ((i + 1) >= argc) {
+      break;
+    }
+
+    if (arg == "--fractal" && !parseFormula(argv[i + 1], fractal.formula)) {
+      throw std::invalid_argument(argv[i + 1]);
+    } else if (arg == "--power") {
+      fractal.power = std::stoul(argv[i + 1]);
+      if (fractal.power < MIN_POWER || fractal.power > MAX_POWER) {
+        throw std::out_of_range(arg);
+      }
+    } else if (arg == "--julia-re") {
+      fractal.c_r = std::stod(argv[i + 1]);
+    } else if (arg == "--julia-im") {
+      fractal.c_i = std::stod(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the render mode based on user inputs if present. Throws if the
+ * requested mode is unknown.
+ */
+void setRenderMode(RenderMode &mode, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--mode" && (i + 1) < argc) {
+      std::string name(argv[i + 1]);
+
+      if (!parseRenderMode(name, mode)) {
+        throw std::invalid_argument(name);
+      }
+    }
+  }
+}
+
+/**
+ * Sets how iteration counts are coloured based on user inputs if present.
+ * Throws if the requested colouring is unknown.
+ */
+void setColouring(Colouring &colouring, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--colouring" && (i + 1) < argc) {
+      std::string name(argv[i + 1]);
+
+      if (!parseColouring(name, colouring)) {
+        throw std::invalid_argument(name);
+      }
+    }
+  }
+}
+
+/**
+ * Sets the memory budget for resumable orbits based on user inputs if
+ * present.
+ */
+void setResumeMemory(size_t &megabytes, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--resume-memory" && (i + 1) < argc) {
+      megabytes = std::stoul(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the memory budget for the tile cache based on user inputs if present.
+ */
+void setCacheMemory(size_t &megabytes, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--cache-memory" && (i + 1) < argc) {
+      megabytes = std::stoul(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the anti-aliasing grid size based on user inputs if present.
+ */
+void setAntialias(unsigned int &samples, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--antialias" && (i + 1) < argc) {
+      samples = std::stoul(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the path to write a trace to based on user inputs if present.
+ */
+void setTracePath(std::string &path, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--trace" && (i + 1) < argc) {
+      path = argv[i + 1];
+    }
+  }
+}
+
+/**
+ * Writes out the trace, if one was asked for
+ */
+void writeTrace(std::string const &path) {
+  if (path.empty()) {
+    return;
+  }
+
+  if (Trace::write(path)) {
+    std::cout << "Wrote out " << path << std::endl;
+  } else {
+    std::cerr << "Could not write " << path << std::endl;
+  }
+}
+
+/**
+ * Returns true if the given flag appears anywhere on the command line
+ */
+bool hasFlag(std::string const &flag, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == flag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Switches off interior shortcuts based on user inputs if present.
+ */
+void setShortcuts(Shortcuts &shortcuts, int argc, char *argv[]) {
+  shortcuts.cardioid = !hasFlag("--no-cardioid-check", argc, argv);
+  shortcuts.periodicity = !hasFlag("--no-periodicity-check", argc, argv);
+  shortcuts.symmetry = !hasFlag("--no-symmetry", argc, argv);
+}
+
+/**
+ * Sets the headless viewport, iterations, colour scheme and output path
+ * based on user inputs if present.
+ */
+void setHeadlessOptions(HeadlessOptions &options, int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+
+    if ((i + 1) >= argc) {
+      break;
+    }
+
+    if (arg == "--center-x") {
+      options.center_x = BigFloat::parse(argv[i + 1]);
+    } else if (arg == "--center-y") {
+      options.center_y = BigFloat::parse(argv[i + 1]);
+    } else if (arg == "--zoom") {
+      options.zoom = std::stod(argv[i + 1]);
+    } else if (arg == "--x-min") {
+      options.x_min = std::stod(argv[i + 1]);
+      options.use_bounds = true;
+    } else if (arg == "--x-max") {
+      options.x_max = std::stod(argv[i + 1]);
+      options.use_bounds = true;
+    } else if (arg == "--y-min") {
+      options.y_min = std::stod(argv[i + 1]);
+      options.use_bounds = true;
+    } else if (arg == "--y-max") {
+      options.y_max = std::stod(argv[i + 1]);
+      options.use_bounds = true;
+    } else if (arg == "--iterations") {
+      options.max_iterations = std::stoi(argv[i + 1]);
+    } else if (arg == "--colour-scheme") {
+      options.colour_scheme = std::stoi(argv[i + 1]);
+    } else if (arg == "--output") {
+      options.output_path = argv[i + 1];
+    } else if (arg == "--strip-height") {
+      options.strip_height = std::stoul(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the animation keyframes file, frames per keyframe and frame rate
+ * based on user inputs if present.
+ */
+void setAnimationOptions(AnimationOptions &options, std::string &path,
+                         int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+
+    if ((i + 1) >= argc) {
+      break;
+    }
+
+    if (arg == "--animate") {
+      path = argv[i + 1];
+    } else if (arg == "--frames-per-key") {
+      options.frames_per_key = std::stoul(argv[i + 1]);
+    } else if (arg == "--fps") {
+      options.fps = std::stoul(argv[i + 1]);
+    }
+  }
+}
+
+/**
+ * Sets the port to serve tiles on and the workers to deal tiles out to based
+ * on user inputs if present.
+ */
+void setDistribution(unsigned short &port, std::vector<WorkerAddress> &workers,
+                     int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+
+    if ((i + 1) >= argc) {
+      break;
+    }
+
+    if (arg == "--worker") {
+      unsigned long number = std::stoul(argv[i + 1]);
+      if (number == 0 || number > 65535) {
+        throw std::out_of_range(arg);
+      }
+      port = number;
+    } else if (arg == "--workers" &&
+               !parseWorkerAddresses(argv[i + 1], workers)) {
+      throw std::invalid_argument(arg);
     }
   }
 }
 
+/**
+ * Whether the output is a video streamed to stdout ("--output -")
+ */
+bool writesToStdout(int argc, char *argv[]) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (std::string(argv[i]) == "--output" &&
+        std::string(argv[i + 1]) == "-") {
+      return true;
+    }
+  }
+  return false;
+}
+
 int main(int argc, char *argv[]) {
   if (argc > 1 &&
       (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
@@ -73,6 +505,11 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  // Messages would corrupt a video streamed to stdout, so they go to stderr
+  if (hasFlag("--animate", argc, argv) && writesToStdout(argc, argv)) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+
   unsigned int screen_width = 800;
   unsigned int screen_height = 600;
 
@@ -85,22 +522,252 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  unsigned int thread_count = std::thread::hardware_concurrency();
+  AffinitySpec affinity;
 
   try {
-    setConcurrency(thread_count, argc, argv);
+    setConcurrency(affinity, argc, argv);
   } catch (...) {
     std::cout << "Error. Please provide integer argument for number of "
-                 "concurrent render threads"
+                 "concurrent render threads, or an affinity spec such as "
+                 "16:pin:reserve=1"
+              << std::endl;
+    return 0;
+  }
+
+  ThreadPlacement placement;
+
+  try {
+    placement = planPlacement(readTopology(), affinity);
+  } catch (std::invalid_argument const &error) {
+    std::cout << "Error: Cannot place render threads: " << error.what()
+              << std::endl;
+    return 0;
+  }
+
+  unsigned int thread_count = placement.threadCount();
+  if (affinity.pin) {
+    std::cout << describePlacement(placement) << std::endl;
+  }
+  // Threads started from here on (other than render threads, which pin
+  // themselves) stay on the UI thread's cores
+  if (!placement.ui_cpus.empty()) {
+    pinThread(placement.ui_cpus);
+  }
+
+  unsigned int tile_size = 32;
+
+  try {
+    setTileSize(tile_size, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Please provide an integer argument for tile size."
+              << std::endl;
+    return 0;
+  }
+
+  KernelType kernel = detectKernel();
+
+  try {
+    setKernelType(kernel, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Unknown kernel, or kernel not supported by this CPU. "
+                 "Please choose one of auto, scalar, sse2, avx2 or avx512."
+              << std::endl;
+    return 0;
+  }
+
+  std::optional<Precision> precision;
+
+  try {
+    setPrecision(precision, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Unknown precision. Please choose one of auto, float, "
+                 "double or double-double."
+              << std::endl;
+    return 0;
+  }
+
+  std::cout << "Using " << kernelName(kernel) << " kernel" << std::endl;
+
+  Fractal fractal;
+
+  try {
+    setFractal(fractal, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Unknown fractal or power. Please choose mandelbrot, "
+                 "julia or burning-ship, with a power from "
+              << MIN_POWER << " to " << MAX_POWER << "." << std::endl;
+    return 0;
+  }
+
+  if (fractal != Fractal()) {
+    std::cout << "Rendering the " << describeFractal(fractal) << std::endl;
+  }
+
+  RenderMode mode = RenderMode::BruteForce;
+
+  try {
+    setRenderMode(mode, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Unknown mode. Please choose brute-force or subdivide."
+              << std::endl;
+    return 0;
+  }
+
+  Shortcuts shortcuts;
+  setShortcuts(shortcuts, argc, argv);
+
+  Colouring colouring = Colouring::Linear;
+
+  try {
+    setColouring(colouring, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Unknown colouring. Please choose linear or histogram."
+              << std::endl;
+    return 0;
+  }
+
+  unsigned int antialias = 0;
+
+  try {
+    setAntialias(antialias, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Please provide an integer argument for anti-aliasing."
+              << std::endl;
+    return 0;
+  }
+
+  std::string trace_path;
+  setTracePath(trace_path, argc, argv);
+  if (!trace_path.empty()) {
+    Trace::enable();
+  }
+
+  unsigned short worker_port = 0;
+  std::vector<WorkerAddress> workers;
+
+  try {
+    setDistribution(worker_port, workers, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Please provide a port number for --worker and a "
+                 "list of host:port for --workers."
+              << std::endl;
+    return 0;
+  }
+
+  if (hasFlag("--headless", argc, argv) || hasFlag("--animate", argc, argv) ||
+      worker_port != 0) {
+    HeadlessOptions options;
+    options.screen_width = screen_width;
+    options.screen_height = screen_height;
+    options.thread_count = thread_count;
+    options.placement = placement;
+    options.tile_size = tile_size;
+    options.kernel = kernel;
+    options.precision = precision;
+    options.fractal = fractal;
+    options.shortcuts = shortcuts;
+    // Each family has its own default view
+    double center_x, center_y;
+    defaultCenter(fractal, center_x, center_y);
+    options.center_x = BigFloat(center_x);
+    options.center_y = BigFloat(center_y);
+    options.mode = mode;
+    options.antialias = antialias;
+    options.colouring = colouring;
+
+    try {
+      setHeadlessOptions(options, argc, argv);
+    } catch (...) {
+      std::cout << "Error: Please provide numeric arguments for the headless "
+                   "viewport, iterations and colour scheme."
+                << std::endl;
+      return 0;
+    }
+
+    if (worker_port != 0) {
+      return runWorker(options, worker_port);
+    }
+
+    if (!workers.empty()) {
+      int result = runCoordinator(options, workers);
+      writeTrace(trace_path);
+      return result;
+    }
+
+    if (hasFlag("--animate", argc, argv)) {
+      AnimationOptions animation;
+      std::string keyframes_path;
+
+      try {
+        setAnimationOptions(animation, keyframes_path, argc, argv);
+      } catch (...) {
+        std::cout << "Error: Please provide integer arguments for frames per "
+                     "keyframe and frame rate."
+                  << std::endl;
+        return 0;
+      }
+
+      if (!loadKeyframes(keyframes_path, animation.keyframes)) {
+        return 1;
+      }
+      if (!hasFlag("--output", argc, argv)) {
+        options.output_path = "mandelbrot";
+      }
+      animation.render = options;
+
+      int result = runAnimation(animation);
+      writeTrace(trace_path);
+      return result;
+    }
+
+    // Strips are streamed out as PNG
+    if (options.strip_height > 0 && !hasFlag("--output", argc, argv)) {
+      options.output_path = "mandelbrot.png";
+    }
+
+    int result = options.strip_height > 0 ? runStrips(options)
+                                          : runHeadless(options);
+    writeTrace(trace_path);
+    return result;
+  }
+
+  size_t resume_megabytes = 64;
+
+  try {
+    setResumeMemory(resume_megabytes, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Please provide an integer argument for resume memory."
+              << std::endl;
+    return 0;
+  }
+
+  size_t cache_megabytes = 128;
+
+  try {
+    setCacheMemory(cache_megabytes, argc, argv);
+  } catch (...) {
+    std::cout << "Error: Please provide an integer argument for cache memory."
               << std::endl;
     return 0;
   }
 
   Renderer renderer(screen_width, screen_height);
-  Mandelbrot mandelbrot(screen_width, screen_height, thread_count);
+  Mandelbrot mandelbrot(screen_width, screen_height, thread_count, tile_size);
+  mandelbrot.setPlacement(placement);
+  mandelbrot.setKernel(kernel);
+  mandelbrot.setPrecision(precision);
+  mandelbrot.setFractal(fractal);
+  mandelbrot.setShortcuts(shortcuts);
+  mandelbrot.setRenderMode(mode);
+  mandelbrot.setProgressive(hasFlag("--progressive", argc, argv));
+  mandelbrot.setAntialias(antialias);
+  mandelbrot.setColouring(colouring);
+  mandelbrot.setResumeMemory(resume_megabytes << 20);
+  mandelbrot.setCacheMemory(cache_megabytes << 20);
   Input input;
 
   mandelbrot.run(input, renderer);
+  writeTrace(trace_path);
 
   return 0;
 }
\ No newline at end of file
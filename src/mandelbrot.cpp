@@ -1,9 +1,9 @@
 #include "mandelbrot.h"
 #include "SDL.h"
-#include "message_queue.h"
+#include "trace.h"
 #include <algorithm>
 #include <cmath>
-#include <complex>
+#include <cstring>
 #include <iostream>
 #include <mutex>
 #include <optional>
@@ -12,6 +12,71 @@
 /* Draw at 24 frames per second */
 constexpr int MILLISECONDS_BETWEEN_FRAMES = 1000 / 24;
 
+/* Subdivision starts from tiles this many times the usual size, and stops
+ * splitting rectangles this narrow (a couple of vector groups) to iterate
+ * them instead */
+constexpr unsigned int SUBDIVISION_TILE_SCALE = 4;
+constexpr unsigned int MIN_SUBDIVISION_SIZE = 32;
+
+/* Zoom factor of one zoom in */
+constexpr double ZOOM_STEP = 0.95;
+
+/* Pixels whose count differs from a neighbour's by more than this are
+ * supersampled by the anti-aliasing pass */
+constexpr unsigned int ANTIALIAS_THRESHOLD = 2;
+
+/* Equalisation histograms have a bin for each escaped count up to this many
+ * bins. Past that, the first half of them still have a count each, and the
+ * rest cover the counts up to the limit in runs that grow in proportion to
+ * the counts, so that histograms stay small at any limit. */
+constexpr unsigned int HISTOGRAM_BINS = 4096;
+constexpr unsigned int EXACT_BINS = HISTOGRAM_BINS / 2;
+
+/** Number of bins the escaped counts of an iteration limit go into; the
+ * pixels that never escaped have one more bin after them
+ */
+unsigned int escapedBins(unsigned int max_iterations) {
+  return std::min(max_iterations, HISTOGRAM_BINS);
+}
+
+/** Bins of the growing runs per unit of log(count) */
+double binsPerLog(unsigned int max_iterations) {
+  return (HISTOGRAM_BINS - EXACT_BINS) /
+         std::log((double)max_iterations / EXACT_BINS);
+}
+
+/** Bin of the equalisation histogram an iteration count goes into */
+unsigned int histogramBin(unsigned int count, unsigned int max_iterations) {
+  if (count < EXACT_BINS || max_iterations <= HISTOGRAM_BINS) {
+    return count;
+  }
+  if (count >= max_iterations) {
+    return HISTOGRAM_BINS;
+  }
+  return EXACT_BINS + (unsigned int)(std::log((double)count / EXACT_BINS) *
+                                     binsPerLog(max_iterations));
+}
+
+/** First iteration count that goes into a bin or one after it */
+unsigned int firstInBin(unsigned int bin, unsigned int max_iterations) {
+  if (bin <= EXACT_BINS || max_iterations <= HISTOGRAM_BINS) {
+    return bin;
+  }
+  if (bin >= HISTOGRAM_BINS) {
+    return max_iterations;
+  }
+  // Rounding may put the estimate a count either side of the boundary
+  unsigned int count = (unsigned int)std::ceil(
+      EXACT_BINS * std::exp((bin - EXACT_BINS) / binsPerLog(max_iterations)));
+  while (count > EXACT_BINS && histogramBin(count - 1, max_iterations) >= bin) {
+    count--;
+  }
+  while (histogramBin(count, max_iterations) < bin) {
+    count++;
+  }
+  return count;
+}
+
 Uint32 bernstein(double f) {
   double h = (1 - f);
 
@@ -51,101 +116,885 @@ Uint32 ghost(double f) {
 const std::vector<Uint32 (*)(double)> colourFunctions{&bernstein, &bernstein2,
                                                       &bernstein3, &ghost};
 
-void updatePixelsInRange(RenderOptions options) {
-  double x_range = options.x_max - options.x_min;
+/** Returns the row that mirrors row j across the real axis, or -1 if there is
+ * no row (to within a thousandth of a pixel) at exactly -y.
+ */
+int mirrorRow(unsigned int j, double y, RenderOptions const &options) {
+  double dy = (options.y_max - options.y_min) / options.screen_height;
+  double mirror = (-y - options.y_min) / dy;
+  double nearest = std::round(mirror);
+
+  if (std::abs(mirror - nearest) > 1e-3 || nearest < 0 ||
+      nearest >= options.screen_height || (unsigned int)nearest == j) {
+    return -1;
+  }
+  return (int)nearest;
+}
+
+/** Colour of every iteration count from 0 to max_iterations, so that
+ * colouring a pixel is a single table lookup
+ */
+std::shared_ptr<std::vector<Uint32> const>
+buildPalette(Uint32 (*colourFunc)(double), unsigned int max_iterations) {
+  auto palette = std::make_shared<std::vector<Uint32>>(max_iterations + 1);
+
+  for (unsigned int n = 0; n < max_iterations; n++) {
+    (*palette)[n] = colourFunc((double)n / (double)max_iterations);
+  }
+  (*palette)[max_iterations] = 0xff000000;
+
+  return palette;
+}
+
+/** Colour of every iteration count from 0 to max_iterations, equalised by a
+ * histogram of the counts: count n gets the colour at the share of escaped
+ * pixels with lower counts, so each part of the scheme covers about as many
+ * pixels whatever the limit. Counts that share a bin are spread evenly over
+ * the bin's share.
+ */
+std::shared_ptr<std::vector<Uint32> const>
+buildEqualisedPalette(Uint32 (*colourFunc)(double),
+                      std::vector<unsigned int> const &histogram,
+                      unsigned int max_iterations) {
+  unsigned int bins = escapedBins(max_iterations);
+  unsigned long long escaped = 0;
+  for (unsigned int b = 0; b < bins; b++) {
+    escaped += histogram[b];
+  }
+  if (escaped == 0) {
+    return buildPalette(colourFunc, max_iterations);
+  }
+
+  auto palette = std::make_shared<std::vector<Uint32>>(max_iterations + 1);
+  unsigned long long below = 0;
+  for (unsigned int b = 0; b < bins; b++) {
+    unsigned int first = firstInBin(b, max_iterations);
+    unsigned int end = firstInBin(b + 1, max_iterations);
+    for (unsigned int n = first; n < end; n++) {
+      double share = below + (double)histogram[b] * (n - first) / (end - first);
+      (*palette)[n] = colourFunc(share / (double)escaped);
+    }
+    below += histogram[b];
+  }
+  (*palette)[max_iterations] = 0xff000000;
+
+  return palette;
+}
+
+/** Maps a run of iteration counts to colours */
+void colourPixels(std::vector<Uint32> const &palette,
+                  unsigned int const *iterations, Uint32 *pixels,
+                  unsigned int width) {
+  Uint32 const *lookup = palette.data();
+
+  // Branch-free, so the compiler is free to vectorise it (with gathers
+  // where the target has them)
+  for (unsigned int i = 0; i < width; i++) {
+    pixels[i] = lookup[iterations[i]];
+  }
+}
+
+/** Colours one run of pixels from their iteration counts */
+void colourPixels(RenderOptions const &options,
+                  unsigned int const *iterations, Uint32 *pixels,
+                  unsigned int width) {
+  colourPixels(*options.palette, iterations, pixels, width);
+}
+
+/** True once a newer frame has replaced the one options belong to. Render
+ * work checks this between rows and gives up early.
+ */
+bool cancelled(RenderOptions const &options) {
+  return options.current_generation &&
+         options.current_generation->load(std::memory_order_relaxed) !=
+             options.generation;
+}
+
+/** True if the frame's points need more than a double to place them: they
+ * can't be listed for the kernel as doubles (xs and ys), which anti-aliasing
+ * and subdivision do, nor told apart by the double coordinates that
+ * mirroring rows and the tile cache go by
+ */
+bool beyondDouble(RenderOptions const &options) {
+  return options.deep || options.precision == Precision::DoubleDouble;
+}
+
+/** Stores the counts of the samples of one row of a pass in the frame's
+ * iteration buffer and colours them, each filling the step x step block it
+ * starts (clipped to the screen)
+ */
+void storeSamples(RenderOptions const &options, unsigned int j,
+                  SampleRun const &run, unsigned int const *iterations) {
+  unsigned int offset = options.screen_width * j;
+
+  if (options.step == 1 && run.stride == 1) {
+    std::copy(iterations, iterations + run.count,
+              &options.iterations[offset + run.first]);
+    colourPixels(options, iterations, &options.pixels[offset + run.first],
+                 run.count);
+    return;
+  }
+
+  std::vector<Uint32> colours(run.count);
+  colourPixels(options, iterations, &colours[0], run.count);
+
+  unsigned int y_end = std::min(j + options.step, options.screen_height);
+  for (unsigned int k = 0; k < run.count; k++) {
+    unsigned int x = run.first + k * run.stride;
+    unsigned int x_end = std::min(x + options.step, options.screen_width);
+    for (unsigned int y = j; y < y_end; y++) {
+      unsigned int block_row = options.screen_width * y;
+      std::fill(&options.iterations[block_row + x],
+                &options.iterations[block_row + x_end], iterations[k]);
+      std::fill(&options.pixels[block_row + x],
+                &options.pixels[block_row + x_end], colours[k]);
+    }
+  }
+}
+
+/** Renders a tile of a deep-zoom frame by perturbation */
+void updateDeepPixelsInRange(RenderOptions const &options, Tile const &tile) {
+  unsigned int width = tile.x1 - tile.x0;
+  std::vector<unsigned int> iterations(width * (tile.y1 - tile.y0));
+  std::vector<unsigned int> samples(width);
+
+  if (!iterateTileDeep(*options.deep, tile, options.max_iterations,
+                       options.step, options.first_pass, &iterations[0],
+                       [&options] { return cancelled(options); })) {
+    return;
+  }
+
+  for (auto j = tile.y0; j < tile.y1; j++) {
+    SampleRun run =
+        samplesInRow(tile.x0, tile.x1, j, options.step, options.first_pass);
+    for (unsigned int k = 0; k < run.count; k++) {
+      samples[k] = iterations[(j - tile.y0) * width + run.first +
+                              k * run.stride - tile.x0];
+    }
+    storeSamples(options, j, run, &samples[0]);
+  }
+}
+
+/** Kernel parameters shared by every row of a frame */
+RowParams frameRowParams(RenderOptions const &options) {
+  RowParams row;
+  row.x0 = options.x_min;
+  row.dx = (options.x_max - options.x_min) / options.screen_width;
+  if (options.precision == Precision::DoubleDouble) {
+    row.x0_lo = options.x_min_lo;
+    row.dx = options.dx;
+  }
+  row.stride = 1;
+  row.max_iterations = options.max_iterations;
+  row.c_r = options.fractal.c_r;
+  row.c_i = options.fractal.c_i;
+  row.cardioid_check = options.shortcuts.cardioid;
+  row.periodicity_check = options.shortcuts.periodicity;
+  return row;
+}
+
+/** Imaginary part of row j */
+double rowY(RenderOptions const &options, unsigned int j) {
   double y_range = options.y_max - options.y_min;
+  return options.y_min + (((double)j / options.screen_height) * (y_range));
+}
+
+/** Sets the imaginary part of row j on a row's parameters, to double-double
+ * precision in double-double frames
+ */
+void setRowY(RenderOptions const &options, unsigned int j, RowParams &row) {
+  if (options.precision != Precision::DoubleDouble) {
+    row.y = rowY(options, j);
+    return;
+  }
+
+  // y_min + offset, with the rounding error of the sum recovered exactly
+  double offset = j * options.dy;
+  row.y = options.y_min + offset;
+  double offset_part = row.y - options.y_min;
+  row.y_lo = (options.y_min - (row.y - offset_part)) +
+             (offset - offset_part) + options.y_min_lo;
+}
+
+/** Carries on the orbits of a tile's pixels that ran out of iterations at
+ * options.resume_from, and recolours the rest for the new limit
+ */
+void resumePixelsInRange(RenderOptions const &options, Tile const &tile) {
+  RowParams row = frameRowParams(options);
+  row.start_iteration = options.resume_from;
+
+  for (auto j = tile.y0; j < tile.y1; j++) {
+    if (cancelled(options)) {
+      return;
+    }
+
+    unsigned int offset = options.screen_width * j;
+    unsigned int *counts = &options.iterations[offset];
+    row.y = rowY(options, j);
+
+    auto resumable = [&](unsigned int i) {
+      return counts[i] == options.resume_from &&
+             !std::isnan(options.orbit_r[offset + i]);
+    };
+
+    unsigned int i = tile.x0;
+    while (i < tile.x1) {
+      if (!resumable(i)) {
+        // Pixels known to be inside stay inside at any limit
+        if (counts[i] == options.resume_from) {
+          counts[i] = options.max_iterations;
+        }
+        i++;
+        continue;
+      }
+
+      unsigned int run_end = i;
+      while (run_end < tile.x1 && resumable(run_end)) {
+        run_end++;
+      }
+
+      row.first = i;
+      row.width = run_end - i;
+      row.orbit_r = &options.orbit_r[offset + i];
+      row.orbit_i = &options.orbit_i[offset + i];
+      options.kernel(row, &counts[i]);
+      i = run_end;
+    }
+
+    colourPixels(options, &counts[tile.x0], &options.pixels[offset + tile.x0],
+                 tile.x1 - tile.x0);
+  }
+}
+
+/** Copies pixels [x0, x1) of row j, with their counts and orbits, over row
+ * mirror, which shows the complex conjugates of its points
+ */
+void copyMirrorRow(RenderOptions const &options, unsigned int j,
+                   unsigned int mirror, unsigned int x0, unsigned int x1) {
+  unsigned int from = options.screen_width * j;
+  unsigned int to = options.screen_width * mirror;
+
+  std::copy(&options.pixels[from + x0], &options.pixels[from + x1],
+            &options.pixels[to + x0]);
+  std::copy(&options.iterations[from + x0], &options.iterations[from + x1],
+            &options.iterations[to + x0]);
+
+  // The orbit of the mirror image is the complex conjugate
+  if (options.orbit_r) {
+    for (unsigned int i = x0; i < x1; i++) {
+      if (options.iterations[from + i] == options.max_iterations) {
+        options.orbit_r[to + i] = options.orbit_r[from + i];
+        options.orbit_i[to + i] = -options.orbit_i[from + i];
+      }
+    }
+  }
+
+  if (options.dirty_rows) {
+    options.dirty_rows->mark(x0, mirror, x1, mirror + 1);
+  }
+}
+
+/** True if the count of pixel (i, j) differs sharply from one of its four
+ * neighbours'
+ */
+bool isEdgePixel(RenderOptions const &options, unsigned int i,
+                 unsigned int j) {
+  unsigned int const *counts = options.iterations;
+  unsigned int width = options.screen_width;
+  unsigned int count = counts[width * j + i];
+
+  auto differs = [&](unsigned int other) {
+    return (count > other ? count - other : other - count) >
+           ANTIALIAS_THRESHOLD;
+  };
+
+  return (i > 0 && differs(counts[width * j + i - 1])) ||
+         (i + 1 < width && differs(counts[width * j + i + 1])) ||
+         (j > 0 && differs(counts[width * (j - 1) + i])) ||
+         (j + 1 < options.screen_height &&
+          differs(counts[width * (j + 1) + i]));
+}
+
+/** Supersamples the edge pixels of a tile on an n x n grid, colouring each
+ * with the average colour of its samples. The samples of all of the tile's
+ * edge pixels go to the kernel as one run of points, so that its lanes stay
+ * full however scattered the edges are. The iteration counts are left as
+ * they were. Returns how many pixels were refined.
+ */
+unsigned long antialiasTile(RenderOptions const &options, Tile const &tile) {
+  unsigned int n = options.antialias;
+  unsigned int width = options.screen_width;
+  double dx = (options.x_max - options.x_min) / width;
+  double dy = (options.y_max - options.y_min) / options.screen_height;
+
+  std::vector<unsigned int> edges;
+  for (auto j = tile.y0; j < tile.y1; j++) {
+    for (auto i = tile.x0; i < tile.x1; i++) {
+      if (isEdgePixel(options, i, j)) {
+        edges.push_back(width * j + i);
+      }
+    }
+  }
+  if (edges.empty() || cancelled(options)) {
+    return 0;
+  }
+
+  // Sample (sx, sy) of a pixel sits at the center of that cell of an n x n
+  // grid over the pixel, which is centered on the pixel's own point
+  unsigned int samples = n * n;
+  std::vector<double> xs(edges.size() * samples);
+  std::vector<double> ys(edges.size() * samples);
+  for (size_t e = 0; e < edges.size(); e++) {
+    unsigned int i = edges[e] % width;
+    unsigned int j = edges[e] / width;
+    for (unsigned int sy = 0; sy < n; sy++) {
+      for (unsigned int sx = 0; sx < n; sx++) {
+        size_t k = e * samples + sy * n + sx;
+        xs[k] = options.x_min + dx * (i + (sx + 0.5) / n - 0.5);
+        ys[k] = rowY(options, j) + dy * ((sy + 0.5) / n - 0.5);
+      }
+    }
+  }
+
+  RowParams row = frameRowParams(options);
+  // Cycle detection is relative to the distance between samples
+  row.dx = dx / n;
+  row.xs = &xs[0];
+  row.ys = &ys[0];
+  row.first = 0;
+  row.width = xs.size();
+
+  std::vector<unsigned int> counts(xs.size());
+  std::vector<Uint32> colours(xs.size());
+  options.kernel(row, &counts[0]);
+  colourPixels(options, &counts[0], &colours[0], colours.size());
+
+  for (size_t e = 0; e < edges.size(); e++) {
+    unsigned int r = 0, g = 0, b = 0;
+    for (unsigned int k = 0; k < samples; k++) {
+      Uint32 colour = colours[e * samples + k];
+      r += colour >> 16 & 0xff;
+      g += colour >> 8 & 0xff;
+      b += colour & 0xff;
+    }
+    options.pixels[edges[e]] = 0xff000000 | (r / samples) << 16 |
+                               (g / samples) << 8 | b / samples;
+  }
+
+  return edges.size();
+}
+
+/** Adds the counts of pixels x0 to x1 of row j to a histogram, weight times
+ * over
+ */
+void countRow(RenderOptions const &options, unsigned int j, unsigned int x0,
+              unsigned int x1, unsigned int weight,
+              std::vector<unsigned int> &histogram) {
+  unsigned int const *counts = &options.iterations[options.screen_width * j];
+  for (auto i = x0; i < x1; i++) {
+    histogram[histogramBin(counts[i], options.max_iterations)] += weight;
+  }
+}
+
+/** Adds the counts of a tile's pixels to a histogram */
+void countTile(RenderOptions const &options, Tile const &tile,
+               std::vector<unsigned int> &histogram) {
+  for (auto j = tile.y0; j < tile.y1; j++) {
+    countRow(options, j, tile.x0, tile.x1, 1, histogram);
+  }
+}
+
+/** Adds bins tile.x0 to tile.x1 of the other render threads' histograms to
+ * the first's
+ */
+void mergeHistograms(RenderOptions const &options, Tile const &tile) {
+  std::vector<std::vector<unsigned int>> &histograms = *options.histograms;
+  for (size_t h = 1; h < histograms.size(); h++) {
+    for (auto b = tile.x0; b < tile.x1; b++) {
+      histograms[0][b] += histograms[h][b];
+    }
+  }
+}
+
+/** Recolours a tile's pixels from their counts */
+void colourTile(RenderOptions const &options, Tile const &tile) {
+  for (auto j = tile.y0; j < tile.y1; j++) {
+    unsigned int offset = options.screen_width * j + tile.x0;
+    colourPixels(options, &options.iterations[offset],
+                 &options.pixels[offset], tile.x1 - tile.x0);
+  }
+}
+
+/** Marks the pixels of a tile as changed, including the blocks of a coarse
+ * pass that reach past its right and bottom edges
+ */
+void markTile(RenderOptions const &options, Tile const &tile) {
+  if (options.dirty_rows) {
+    options.dirty_rows->mark(tile.x0, tile.y0, tile.x1 + options.step - 1,
+                             tile.y1 + options.step - 1);
+  }
+}
+
+/** Renders a tile of a frame. Returns false if some of its rows are left for
+ * the tiles across the real axis to mirror over. If histogram is set, the
+ * pass must be the frame's full-resolution one, and the counts of the rows
+ * it completes (mirrored ones included) are added to the histogram while
+ * they are still in cache.
+ */
+bool updatePixelsInRange(RenderOptions const &options, Tile const &tile,
+                         std::vector<unsigned int> *histogram = nullptr) {
+  if (options.deep || options.resume_from > 0) {
+    if (options.deep) {
+      updateDeepPixelsInRange(options, tile);
+    } else {
+      resumePixelsInRange(options, tile);
+    }
+    if (histogram && !cancelled(options)) {
+      countTile(options, tile, *histogram);
+    }
+    return true;
+  }
 
-  Uint32 (*colourFunc)(double) = options.colouring_function;
+  bool complete = true;
 
-  for (auto j = options.offset; j < options.screen_height;
-       j += options.skip_count) {
-    for (auto i = 0; i < options.screen_width; i++) {
-      std::complex<double> c{
-          options.x_min + (((double)i / options.screen_width) * (x_range)),
-          options.y_min + (((double)j / options.screen_height) * (y_range))};
+  RowParams row = frameRowParams(options);
+  std::vector<unsigned int> iterations(tile.x1 - tile.x0);
+  std::vector<double> run_r, run_i;
+  if (options.orbit_r) {
+    run_r.resize(tile.x1 - tile.x0);
+    run_i.resize(tile.x1 - tile.x0);
+    row.orbit_r = &run_r[0];
+    row.orbit_i = &run_i[0];
+  }
 
-      std::complex<double> z{0, 0};
+  for (auto j = tile.y0; j < tile.y1; j++) {
+    SampleRun run =
+        samplesInRow(tile.x0, tile.x1, j, options.step, options.first_pass);
+    if (run.count == 0) {
+      // Coarser passes already did the whole row
+      if (histogram) {
+        countRow(options, j, tile.x0, tile.x1, 1, *histogram);
+      }
+      continue;
+    }
+    if (cancelled(options)) {
+      return false;
+    }
 
-      unsigned int iteration = 0;
+    setRowY(options, j, row);
 
-      for (iteration = 0; iteration < options.max_iterations; iteration++) {
+    // When the view straddles the real axis only the rows with y > 0 are
+    // iterated, and each is copied over its mirror image
+    int mirror =
+        options.shortcuts.symmetry ? mirrorRow(j, row.y, options) : -1;
+    if (mirror >= 0 && row.y < 0) {
+      complete = false;
+      continue;
+    }
+
+    row.first = run.first;
+    row.stride = run.stride;
+    row.width = run.count;
+    options.kernel(row, &iterations[0]);
 
-        z = (z * z) + c; // You love to see it
+    storeSamples(options, j, run, &iterations[0]);
 
-        if (abs(z) >= 2.0) {
-          break;
+    unsigned int from = options.screen_width * j;
+    if (options.orbit_r) {
+      for (unsigned int k = 0; k < run.count; k++) {
+        if (iterations[k] == options.max_iterations) {
+          options.orbit_r[from + run.first + k * run.stride] = run_r[k];
+          options.orbit_i[from + run.first + k * run.stride] = run_i[k];
         }
       }
+    }
+
+    if (mirror >= 0) {
+      copyMirrorRow(options, j, mirror, tile.x0, tile.x1);
+    }
+    if (histogram) {
+      countRow(options, j, tile.x0, tile.x1, mirror >= 0 ? 2 : 1, *histogram);
+    }
+  }
+
+  return complete;
+}
+
+/** The position on the lattice of tiles edge pixels wide of the first tile
+ * boundary after pos, where lattice is the lattice position of pixel 0
+ */
+unsigned int nextTileBoundary(unsigned int pos, unsigned int edge,
+                              long long lattice) {
+  long long offset = (lattice + pos) % (long long)edge;
+  if (offset < 0) {
+    offset += edge;
+  }
+  return pos + edge - (unsigned int)offset;
+}
+
+/** Cuts a region along the tile boundaries of the frame's lattice */
+std::vector<Tile> splitOnLattice(Tile const &region, unsigned int edge,
+                                 RenderOptions const &options) {
+  std::vector<Tile> tiles;
+
+  for (unsigned int y = region.y0; y < region.y1;) {
+    unsigned int y_end =
+        std::min(region.y1, nextTileBoundary(y, edge, options.lattice_y));
+    for (unsigned int x = region.x0; x < region.x1;) {
+      unsigned int x_end =
+          std::min(region.x1, nextTileBoundary(x, edge, options.lattice_x));
+      tiles.push_back(Tile{x, y, x_end, y_end});
+      x = x_end;
+    }
+    y = y_end;
+  }
+
+  return tiles;
+}
+
+/** Key of a tile of the frame in the tile cache, or false if the tile isn't
+ * a whole tile of the lattice
+ */
+bool cacheKey(RenderOptions const &options, Tile const &tile, TileKey &key) {
+  unsigned int size = options.cache_key.tile_size;
+  long long x = options.lattice_x + tile.x0;
+  long long y = options.lattice_y + tile.y0;
+
+  if (tile.x1 - tile.x0 != size || tile.y1 - tile.y0 != size ||
+      x % (long long)size != 0 || y % (long long)size != 0) {
+    return false;
+  }
+
+  key = options.cache_key;
+  key.tile_x = x / (long long)size;
+  key.tile_y = y / (long long)size;
+  return true;
+}
+
+/** Total of the iteration counts of the pixels a tile's pass computed (not
+ * the ones it only filled in)
+ */
+unsigned long long tileIterations(RenderOptions const &options,
+                                  Tile const &tile) {
+  unsigned long long total = 0;
+  for (unsigned int j = tile.y0; j < tile.y1; j++) {
+    SampleRun run =
+        samplesInRow(tile.x0, tile.x1, j, options.step, options.first_pass);
+    unsigned int const *counts = &options.iterations[options.screen_width * j];
+    for (unsigned int k = 0; k < run.count; k++) {
+      total += counts[run.first + k * run.stride];
+    }
+  }
+  return total;
+}
+
+/** Iterates pixels [x0, x1) of row j into the frame's iteration counts and
+ * colours them
+ */
+void iterateSpan(RenderOptions const &options, unsigned int j, unsigned int x0,
+                 unsigned int x1) {
+  RowParams row = frameRowParams(options);
+  setRowY(options, j, row);
+  row.first = x0;
+  row.width = x1 - x0;
+
+  unsigned int offset = options.screen_width * j + x0;
+  options.kernel(row, &options.iterations[offset]);
+  colourPixels(options, &options.iterations[offset], &options.pixels[offset],
+               row.width);
+}
+
+/** Iterates pixels [y0, y1) of column i like iterateSpan, as a run with an
+ * imaginary part per pixel
+ */
+void iterateColumn(RenderOptions const &options, unsigned int i,
+                   unsigned int y0, unsigned int y1) {
+  if (y0 >= y1) {
+    return;
+  }
+
+  std::vector<double> ys(y1 - y0);
+  std::vector<unsigned int> counts(y1 - y0);
+  for (unsigned int j = y0; j < y1; j++) {
+    ys[j - y0] = rowY(options, j);
+  }
+
+  RowParams row = frameRowParams(options);
+  row.ys = &ys[0];
+  row.first = i;
+  row.stride = 0;
+  row.width = y1 - y0;
+  options.kernel(row, &counts[0]);
+
+  for (unsigned int j = y0; j < y1; j++) {
+    unsigned int offset = options.screen_width * j + i;
+    options.iterations[offset] = counts[j - y0];
+    colourPixels(options, &counts[j - y0], &options.pixels[offset], 1);
+  }
+}
+
+/** True if every pixel on the border of the tile has the same count */
+bool uniformBorder(RenderOptions const &options, Tile const &tile) {
+  unsigned int const *counts = options.iterations;
+  unsigned int width = options.screen_width;
+  unsigned int value = counts[width * tile.y0 + tile.x0];
+
+  for (unsigned int i = tile.x0; i < tile.x1; i++) {
+    if (counts[width * tile.y0 + i] != value ||
+        counts[width * (tile.y1 - 1) + i] != value) {
+      return false;
+    }
+  }
+  for (unsigned int j = tile.y0; j < tile.y1; j++) {
+    if (counts[width * j + tile.x0] != value ||
+        counts[width * j + tile.x1 - 1] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Mariani-Silver subdivision of one rectangle. The Mandelbrot set and its
+ * escape-time bands are simply connected, so if the whole border of a
+ * rectangle shares one count, so does its interior. Otherwise the rectangle
+ * is split into four along a middle row and column, which become part of
+ * the borders of the quarters returned in children.
+ */
+void subdivideTile(RenderOptions const &options, Tile const &tile,
+                   bool border_known, std::vector<Tile> &children) {
+  unsigned int width = tile.x1 - tile.x0;
+  unsigned int height = tile.y1 - tile.y0;
+
+  if (cancelled(options)) {
+    return;
+  }
+
+  if (!border_known) {
+    iterateSpan(options, tile.y0, tile.x0, tile.x1);
+    if (height > 1) {
+      iterateSpan(options, tile.y1 - 1, tile.x0, tile.x1);
+    }
+    if (height > 2) {
+      iterateColumn(options, tile.x0, tile.y0 + 1, tile.y1 - 1);
+      if (width > 1) {
+        iterateColumn(options, tile.x1 - 1, tile.y0 + 1, tile.y1 - 1);
+      }
+    }
+  }
+
+  // Nothing inside the border
+  if (width <= 2 || height <= 2) {
+    return;
+  }
+
+  if (uniformBorder(options, tile)) {
+    unsigned int value = options.iterations[options.screen_width * tile.y0 +
+                                            tile.x0];
+    Uint32 colour;
+    colourPixels(options, &value, &colour, 1);
+
+    for (unsigned int j = tile.y0 + 1; j < tile.y1 - 1; j++) {
+      unsigned int offset = options.screen_width * j;
+      std::fill(&options.iterations[offset + tile.x0 + 1],
+                &options.iterations[offset + tile.x1 - 1], value);
+      std::fill(&options.pixels[offset + tile.x0 + 1],
+                &options.pixels[offset + tile.x1 - 1], colour);
+    }
+    return;
+  }
+
+  if (width <= MIN_SUBDIVISION_SIZE || height <= MIN_SUBDIVISION_SIZE) {
+    for (unsigned int j = tile.y0 + 1; j < tile.y1 - 1; j++) {
+      if (cancelled(options)) {
+        return;
+      }
+      iterateSpan(options, j, tile.x0 + 1, tile.x1 - 1);
+    }
+    return;
+  }
 
-      if (iteration == options.max_iterations) {
-        options.pixels[(options.screen_width * j) + i] = 0xff000000;
+  unsigned int mid_x = tile.x0 + width / 2;
+  unsigned int mid_y = tile.y0 + height / 2;
+
+  iterateSpan(options, mid_y, tile.x0 + 1, tile.x1 - 1);
+  iterateColumn(options, mid_x, tile.y0 + 1, mid_y);
+  iterateColumn(options, mid_x, mid_y + 1, tile.y1 - 1);
+
+  children.push_back(Tile{tile.x0, tile.y0, mid_x + 1, mid_y + 1});
+  children.push_back(Tile{mid_x, tile.y0, tile.x1, mid_y + 1});
+  children.push_back(Tile{tile.x0, mid_y, mid_x + 1, tile.y1});
+  children.push_back(Tile{mid_x, mid_y, tile.x1, tile.y1});
+}
+
+/** Moves the image by whole pixels, so that new pixel (i, j) shows what old
+ * pixel (i + shift_x, j + shift_y) did. Pixels shifted in from outside are
+ * left as they were, for the caller to recompute.
+ */
+template <typename T>
+void shiftPixels(std::vector<T> &pixels, unsigned int width,
+                 unsigned int height, int shift_x, int shift_y) {
+  unsigned int run = width - std::abs(shift_x);
+  unsigned int to_x = std::max(0, -shift_x);
+  unsigned int from_x = std::max(0, shift_x);
+
+  // Walk rows in the direction that never overwrites a row still to be read
+  for (unsigned int k = 0; k < height; k++) {
+    int j = shift_y > 0 ? k : height - 1 - k;
+    int from_j = j + shift_y;
+    if (from_j < 0 || from_j >= (int)height) {
+      continue;
+    }
+    std::memmove(&pixels[j * width + to_x], &pixels[from_j * width + from_x],
+                 run * sizeof(T));
+  }
+}
+
+/** Resamples the previous frame (nearest neighbour) onto a new center and
+ * zoom, as a preview to show while the new frame is computed.
+ */
+template <typename T>
+void reprojectPixels(std::vector<T> &pixels, unsigned int width,
+                     unsigned int height, FrameState const &from,
+                     FrameState const &to, T outside) {
+  std::vector<T> previous(pixels);
+
+  double from_dx = from.zoom * from.x_range / width;
+  double from_dy = from.zoom * from.y_range / height;
+  double scale = to.zoom / from.zoom;
+  double offset_x = (to.center_x - from.center_x).toDouble() / from_dx;
+  double offset_y = (to.center_y - from.center_y).toDouble() / from_dy;
+
+  for (unsigned int j = 0; j < height; j++) {
+    double y = height / 2.0 + offset_y + (j - height / 2.0) * scale;
+    int from_j = (int)std::floor(y + 0.5);
+
+    for (unsigned int i = 0; i < width; i++) {
+      double x = width / 2.0 + offset_x + (i - width / 2.0) * scale;
+      int from_i = (int)std::floor(x + 0.5);
+
+      if (from_i < 0 || from_i >= (int)width || from_j < 0 ||
+          from_j >= (int)height) {
+        pixels[j * width + i] = outside;
       } else {
-        options.pixels[(options.screen_width * j) + i] =
-            colourFunc((double)iteration / (double)options.max_iterations);
+        pixels[j * width + i] = previous[from_j * width + from_i];
       }
     }
   }
 }
 
-void renderLoop(MessageQueue<RenderOptions> &queue, bool &running) {
-  while (running) {
-    std::optional<RenderOptions> options = queue.receive();
-    if (options) {
-      updatePixelsInRange(options.value());
+std::string renderModeName(RenderMode mode) {
+  switch (mode) {
+  case RenderMode::Subdivide:
+    return "subdivide";
+  default:
+    return "brute-force";
+  }
+}
+
+bool parseRenderMode(std::string const &name, RenderMode &mode) {
+  for (RenderMode candidate : {RenderMode::BruteForce, RenderMode::Subdivide}) {
+    if (renderModeName(candidate) == name) {
+      mode = candidate;
+      return true;
     }
-    // otherwise, allow to re-enter while loop
-    // (if running is false, the thread should terminate)
   }
+  return false;
 }
 
-Mandelbrot::~Mandelbrot() {
-  // Clearing the queue means all the threads will wake up and recheck
-  // if they're supposed to be running
-  queue.stop();
-  queue.clear();
+std::string colouringName(Colouring colouring) {
+  switch (colouring) {
+  case Colouring::Histogram:
+    return "histogram";
+  default:
+    return "linear";
+  }
+}
 
-  // Wait for all render threads to exit (they might be mid-task)
-  for (auto &t : render_threads) {
-    t.join();
+bool parseColouring(std::string const &name, Colouring &colouring) {
+  for (Colouring candidate : {Colouring::Linear, Colouring::Histogram}) {
+    if (colouringName(candidate) == name) {
+      colouring = candidate;
+      return true;
+    }
   }
+  return false;
+}
+
+/** True if two frames differ at most in their center, zoom and iteration
+ * limit
+ */
+bool sameContent(FrameState const &a, FrameState const &b) {
+  return a.valid && b.valid && a.x_range == b.x_range &&
+         a.y_range == b.y_range && a.colour_scheme_id == b.colour_scheme_id &&
+         a.colouring == b.colouring &&
+         a.kernel == b.kernel && a.fractal == b.fractal && a.mode == b.mode &&
+         a.shortcuts.cardioid == b.shortcuts.cardioid &&
+         a.shortcuts.periodicity == b.shortcuts.periodicity &&
+         a.shortcuts.symmetry == b.shortcuts.symmetry &&
+         a.antialias_samples == b.antialias_samples;
+}
+
+Mandelbrot::~Mandelbrot() {
+  // Destroying the scheduler wakes all the render threads and waits for
+  // them to exit (they might be mid-tile)
+  scheduler.reset();
 }
 
 void Mandelbrot::resetBounds() {
+  x_range = 3.0;
+  y_range = 2.5;
   zoom = 1.0;
-  center_y = 0.0;
-  center_x = -1.0;
+  double x, y;
+  defaultCenter(fractal, x, y);
+  center_x = BigFloat(x);
+  center_y = BigFloat(y);
   max_iterations = 50;
+  resetLattice();
   setBoundsFromState();
 }
 
+void Mandelbrot::resetLattice() {
+  anchor_x = center_x;
+  anchor_y = center_y;
+  zoom_base = zoom;
+  zoom_level = 0;
+}
+
 void Mandelbrot::zoomIn() {
-  zoom *= 0.95;
+  // Zoom levels are computed from scratch rather than accumulated, so that
+  // zooming back out lands on exactly the zoom of a level seen before
+  zoom_level++;
+  zoom = zoom_base * std::pow(ZOOM_STEP, zoom_level);
   setBoundsFromState();
 }
 
 void Mandelbrot::zoomOut() {
-  zoom *= 1.05;
+  zoom_level--;
+  zoom = zoom_base * std::pow(ZOOM_STEP, zoom_level);
   setBoundsFromState();
 }
 
 void Mandelbrot::moveUp() {
-  center_y -= 0.1 * zoom;
-  setBoundsFromState();
+  moveCenter(0.0, -panDistance(screen_height, y_range));
 }
 
 void Mandelbrot::moveLeft() {
-  center_x -= 0.1 * zoom;
-  setBoundsFromState();
+  moveCenter(-panDistance(screen_width, x_range), 0.0);
 }
 
 void Mandelbrot::moveDown() {
-  center_y += 0.1 * zoom;
-  setBoundsFromState();
+  moveCenter(0.0, panDistance(screen_height, y_range));
 }
 
 void Mandelbrot::moveRight() {
-  center_x += 0.1 * zoom;
-  setBoundsFromState();
+  moveCenter(panDistance(screen_width, x_range), 0.0);
+}
+
+double Mandelbrot::panDistance(unsigned int screen_size, double range) const {
+  // About a tenth of the view, rounded to whole pixels so that the rest of
+  // the frame can simply be shifted across
+  double pixels = std::max(1.0, std::round(0.1 * screen_size / range));
+  return pixels * (zoom * range / screen_size);
 }
 
 void Mandelbrot::increaseIterations() {
@@ -163,9 +1012,222 @@ void Mandelbrot::decreaseIterations() {
 void Mandelbrot::nextColourScheme() {
   colour_scheme_id = (colour_scheme_id + 1) % colourFunctions.size();
 
+  // The iteration counts stay valid, only the colours need redoing
+  recolour = true;
+}
+
+void Mandelbrot::setCenter(double x, double y) {
+  setCenter(BigFloat(x), BigFloat(y));
+}
+
+void Mandelbrot::setCenter(BigFloat const &x, BigFloat const &y) {
+  center_x = x;
+  center_y = y;
+  resetLattice();
+  setBoundsFromState();
+}
+
+void Mandelbrot::moveCenter(double dx, double dy) {
+  center_x = center_x + BigFloat(dx);
+  center_y = center_y + BigFloat(dy);
+  setBoundsFromState();
+}
+
+void Mandelbrot::setZoom(double new_zoom) {
+  zoom = new_zoom;
+  resetLattice();
+  setBoundsFromState();
+}
+
+void Mandelbrot::setBounds(double new_x_min, double new_x_max,
+                           double new_y_min, double new_y_max) {
+  // The explicit bounds become the unzoomed view, so that zooming and
+  // panning afterwards behave relative to them
+  x_range = new_x_max - new_x_min;
+  y_range = new_y_max - new_y_min;
+  center_x = BigFloat(new_x_min + (x_range / 2.0));
+  center_y = BigFloat(new_y_min + (y_range / 2.0));
+  zoom = 1.0;
+  resetLattice();
+  setBoundsFromState();
+}
+
+void Mandelbrot::cropTo(unsigned int full_width, unsigned int full_height,
+                        unsigned int x0, unsigned int y0) {
+  // Pixels keep the spacing they have in the full view. The crop's center is
+  // a whole number of half pixels from the full view's, an offset a double
+  // holds at any depth, while the center keeps its full precision.
+  double dx = zoom * x_range / full_width;
+  double dy = zoom * y_range / full_height;
+  center_x = center_x + BigFloat(dx * (x0 + screen_width / 2.0 -
+                                       full_width / 2.0));
+  center_y = center_y + BigFloat(dy * (y0 + screen_height / 2.0 -
+                                       full_height / 2.0));
+  x_range = x_range * screen_width / full_width;
+  y_range = y_range * screen_height / full_height;
+  resetLattice();
+  setBoundsFromState();
+}
+
+void Mandelbrot::setIterations(unsigned int iterations) {
+  max_iterations = iterations;
   setDirty();
 }
 
+void Mandelbrot::setColourScheme(unsigned int id) {
+  colour_scheme_id = id % colourFunctions.size();
+  setDirty();
+}
+
+void Mandelbrot::setColouring(Colouring new_colouring) {
+  colouring = new_colouring;
+  setDirty();
+}
+
+void Mandelbrot::toggleColouring() {
+  setColouring(colouring == Colouring::Linear ? Colouring::Histogram
+                                              : Colouring::Linear);
+  std::cout << "Colouring: " << colouringName(colouring) << std::endl;
+}
+
+void Mandelbrot::setColourHistogram(
+    std::vector<unsigned int> const &histogram) {
+  colour_histogram = histogram;
+  fixed_histogram = true;
+  setDirty();
+}
+
+void Mandelbrot::setPrecision(std::optional<Precision> forced) {
+  forced_precision = forced;
+  setDirty();
+}
+
+std::string Mandelbrot::arithmetic() const {
+  return deep_view ? "perturbation" : precisionName(precision);
+}
+
+void Mandelbrot::setKernel(KernelType type) {
+  kernel_type = type;
+  kernel = getKernel(type, fractal);
+  perturbation_kernel = getPerturbationKernel(type);
+  setDirty();
+}
+
+void Mandelbrot::setFractal(Fractal const &new_fractal) {
+  bool same_family = new_fractal.formula == fractal.formula &&
+                     new_fractal.power == fractal.power;
+  fractal = new_fractal;
+  kernel = getKernel(kernel_type, fractal);
+
+  // A Julia set given directly goes back to the plane of its power
+  if (fractal.formula == Formula::Julia) {
+    julia_parent = Fractal();
+    julia_parent.power = fractal.power;
+    double x, y;
+    defaultCenter(julia_parent, x, y);
+    julia_parent_x = BigFloat(x);
+    julia_parent_y = BigFloat(y);
+    julia_parent_zoom = 1.0;
+  }
+
+  if (!same_family) {
+    double x, y;
+    defaultCenter(fractal, x, y);
+    center_x = BigFloat(x);
+    center_y = BigFloat(y);
+    zoom = 1.0;
+    resetLattice();
+    setBoundsFromState();
+  }
+  setDirty();
+}
+
+void Mandelbrot::toggleJulia() {
+  if (fractal.formula == Formula::Julia) {
+    // Back to the view the constant was picked in
+    fractal = julia_parent;
+    center_x = julia_parent_x;
+    center_y = julia_parent_y;
+    zoom = julia_parent_zoom;
+  } else {
+    // c is the point under the mouse, to within a pixel
+    double offset_x = ((double)mouse_x / screen_width - 0.5) * (zoom * x_range);
+    double offset_y =
+        ((double)mouse_y / screen_height - 0.5) * (zoom * y_range);
+    julia_parent = fractal;
+    julia_parent_x = center_x;
+    julia_parent_y = center_y;
+    julia_parent_zoom = zoom;
+
+    fractal.formula = Formula::Julia;
+    fractal.c_r = (center_x + BigFloat(offset_x)).toDouble();
+    fractal.c_i = (center_y + BigFloat(offset_y)).toDouble();
+    double x, y;
+    defaultCenter(fractal, x, y);
+    center_x = BigFloat(x);
+    center_y = BigFloat(y);
+    zoom = 1.0;
+    std::cout << describeFractal(fractal) << std::endl;
+  }
+
+  kernel = getKernel(kernel_type, fractal);
+  resetLattice();
+  setBoundsFromState();
+}
+
+void Mandelbrot::setShortcuts(Shortcuts new_shortcuts) {
+  shortcuts = new_shortcuts;
+  setDirty();
+}
+
+void Mandelbrot::setProgressive(bool enabled) {
+  progressive = enabled;
+  setDirty();
+}
+
+void Mandelbrot::setRenderMode(RenderMode new_mode) {
+  mode = new_mode;
+  setDirty();
+}
+
+void Mandelbrot::setAntialias(unsigned int samples) {
+  antialias_samples = samples >= 2 ? samples : 0;
+  setDirty();
+}
+
+void Mandelbrot::setResumeMemory(size_t bytes) {
+  resume_memory = bytes;
+  setDirty();
+}
+
+void Mandelbrot::setCacheMemory(size_t bytes) {
+  // Tiles still being computed may be about to go into the old cache
+  if (scheduler) {
+    scheduler->clear();
+    scheduler->wait();
+  }
+
+  tile_cache.reset();
+  if (bytes > 0) {
+    tile_cache = std::make_unique<TileCache>(bytes);
+  }
+  setDirty();
+}
+
+CancelStats Mandelbrot::cancelStats() const {
+  CancelStats stats;
+  stats.dropped = dropped_jobs;
+  stats.aborted = aborted_jobs;
+  return stats;
+}
+
+TileCacheStats Mandelbrot::cacheStats() const {
+  if (!tile_cache) {
+    return {};
+  }
+  return tile_cache->stats();
+}
+
 void Mandelbrot::onMouseDown(int x, int y) {
   selection.x = x;
   selection.y = y;
@@ -184,9 +1246,12 @@ void Mandelbrot::onMouseUp(int x, int y) {
   int x_mid = x_start + ((float)(x_end - x_start) / 2.0);
   int y_mid = y_start + ((float)(y_end - y_start) / 2.0);
 
-  // get new center
-  center_x = x_min + (((float)x_mid / (float)screen_width) * (x_max - x_min));
-  center_y = y_min + (((float)y_mid / (float)screen_height) * (y_max - y_min));
+  // get new center, as an offset from the old one so that it keeps full
+  // precision at deep zooms
+  double offset_x = ((double)x_mid / screen_width - 0.5) * (zoom * x_range);
+  double offset_y = ((double)y_mid / screen_height - 0.5) * (zoom * y_range);
+  center_x = center_x + BigFloat(offset_x);
+  center_y = center_y + BigFloat(offset_y);
 
   // set zoom based on hypotenuse of zoom rectangle
   double zoom_hypotenuse = sqrt((x_end - x_start) * (x_end - x_start) +
@@ -195,6 +1260,7 @@ void Mandelbrot::onMouseUp(int x, int y) {
       sqrt(screen_width * screen_width + screen_height * screen_height);
 
   zoom *= zoom_hypotenuse / window_hypotenuse;
+  resetLattice();
 
   // Set bounds based on new center and zoom
   setBoundsFromState();
@@ -211,12 +1277,55 @@ void Mandelbrot::onMouseUp(int x, int y) {
   setDirty();
 }
 
+void Mandelbrot::colourCounts(std::vector<unsigned int> const &counts,
+                              std::vector<Uint32> &pixels) const {
+  std::shared_ptr<std::vector<Uint32> const> palette = framePalette();
+  if (colouring == Colouring::Histogram && !fixed_histogram) {
+    std::vector<unsigned int> histogram(escapedBins(max_iterations) + 1, 0);
+    for (unsigned int count : counts) {
+      histogram[histogramBin(std::min(count, max_iterations),
+                             max_iterations)]++;
+    }
+    palette = buildEqualisedPalette(colourFunctions[colour_scheme_id],
+                                    histogram, max_iterations);
+  }
+
+  colourPixels(*palette, &counts[0], &pixels[0], counts.size());
+}
+
+std::shared_ptr<std::vector<Uint32> const> Mandelbrot::framePalette() const {
+  Uint32 (*colour)(double) = colourFunctions[colour_scheme_id];
+
+  // Until a frame has its own histogram, it is coloured with the last one
+  if (colouring == Colouring::Histogram &&
+      colour_histogram.size() == escapedBins(max_iterations) + 1) {
+    return buildEqualisedPalette(colour, colour_histogram, max_iterations);
+  }
+  return buildPalette(colour, max_iterations);
+}
+
+void Mandelbrot::recolourFrame(std::vector<Uint32> &pixels) {
+  std::shared_ptr<std::vector<Uint32> const> palette = framePalette();
+
+  colourPixels(*palette, &iterations[0], &pixels[0], iterations.size());
+  frame.colour_scheme_id = colour_scheme_id;
+  if (dirty_rows) {
+    dirty_rows->markAll();
+  }
+}
+
 void Mandelbrot::setDirty() {
+  // note when the first input since the last dispatch arrived
+  if (!dirty) {
+    input_time = std::chrono::steady_clock::now();
+  }
   // set dirty flag
   dirty = true;
 }
 
 void Mandelbrot::onMouseMove(int x, int y) {
+  mouse_x = x;
+  mouse_y = y;
   if (dragging) {
     selection.w = x - selection.x;
     selection.h = y - selection.y;
@@ -224,77 +1333,862 @@ void Mandelbrot::onMouseMove(int x, int y) {
 }
 
 void Mandelbrot::setBoundsFromState() {
-  x_min = center_x - (zoom * (x_range / 2.0));
-  x_max = center_x + (zoom * (x_range / 2.0));
-  y_min = center_y - (zoom * (y_range / 2.0));
-  y_max = center_y + (zoom * (y_range / 2.0));
+  x_min = center_x.toDouble() - (zoom * (x_range / 2.0));
+  x_max = center_x.toDouble() + (zoom * (x_range / 2.0));
+  y_min = center_y.toDouble() - (zoom * (y_range / 2.0));
+  y_max = center_y.toDouble() + (zoom * (y_range / 2.0));
 
   setDirty();
 }
 
 void Mandelbrot::stop() { running = false; }
 
-void Mandelbrot::run(Input const &Input, Renderer &renderer) {
+void Mandelbrot::setPlacement(ThreadPlacement const &new_placement) {
+  if (!scheduler) {
+    placement = new_placement;
+    thread_count = placement.threadCount();
+  }
+}
+
+void Mandelbrot::placeRows(void *data, size_t row_bytes) {
+  firstTouchRows(data, row_bytes, band_starts, placement);
+}
+
+void Mandelbrot::startRenderThreads() {
+  if (scheduler) {
+    return;
+  }
+
+  if (placement.threadCount() != thread_count) {
+    placement = ThreadPlacement::unpinned(thread_count);
+  }
+
+  // Each group's band has as many rows as its share of the threads
+  band_starts.assign(1, 0);
+  for (unsigned int g = 0; g < placement.groupCount(); g++) {
+    band_starts.push_back(
+        band_starts.back() +
+        screen_height * placement.group_cpus[g].size() / thread_count);
+  }
+  band_starts.back() = screen_height;
+
+  scheduler = std::make_unique<TileScheduler<RenderJob>>(
+      thread_count,
+      [this](RenderJob &job, unsigned int worker) {
+        RenderOptions const &options = *job.options;
+
+        if (job.queued_ns >= 0) {
+          static thread_local bool named = false;
+          if (!named) {
+            Trace::setThreadName("render " + std::to_string(worker));
+            named = true;
+          }
+          Trace::record("queue wait", job.queued_ns, Trace::now());
+        }
+        TraceSpan span("tile");
+
+        if (options.antialias > 0) {
+          antialiased_pixels += antialiasTile(options, job.tile);
+          markTile(options, job.tile);
+          return;
+        }
+
+        if (options.merge_only) {
+          mergeHistograms(options, job.tile);
+          return;
+        }
+
+        if (options.count_only) {
+          if (!cancelled(options)) {
+            countTile(options, job.tile, (*options.histograms)[worker]);
+          }
+          return;
+        }
+
+        if (options.colour_only) {
+          if (!cancelled(options)) {
+            colourTile(options, job.tile);
+            markTile(options, job.tile);
+          }
+          return;
+        }
+
+        // Jobs of a replaced frame stop at the next row; what they leave
+        // behind is neither cached nor subdivided further
+        if (options.mode != RenderMode::Subdivide || beyondDouble(options)) {
+          // The full-resolution pass counts the pixels it completes
+          std::vector<unsigned int> *histogram =
+              options.histograms && options.step == 1
+                  ? &(*options.histograms)[worker]
+                  : nullptr;
+          bool complete = updatePixelsInRange(options, job.tile, histogram);
+          markTile(options, job.tile);
+          if (cancelled(options)) {
+            aborted_jobs++;
+            return;
+          }
+
+          if (Trace::enabled()) {
+            unsigned long long computed = tileIterations(options, job.tile);
+            span.setArg("iterations", computed);
+            frame_iterations += computed;
+          }
+
+          TileKey key;
+          if (complete && options.cache && options.step == 1 &&
+              cacheKey(options, job.tile, key)) {
+            options.cache->insert(
+                key,
+                &options.iterations[options.screen_width * job.tile.y0 +
+                                    job.tile.x0],
+                options.screen_width);
+          }
+          return;
+        }
+
+        // Quarters go on this worker's own deque, for it to carry on with
+        // depth-first and for idle workers to steal
+        std::vector<Tile> children;
+        subdivideTile(options, job.tile, job.border_known, children);
+        markTile(options, job.tile);
+        if (cancelled(options)) {
+          aborted_jobs++;
+          return;
+        }
+
+        long long queued = Trace::enabled() ? Trace::now() : -1;
+        for (Tile const &child : children) {
+          scheduler->push(worker,
+                          RenderJob{job.options, child, true, queued});
+        }
+      },
+      placement.worker_groups,
+      [this](unsigned int worker) {
+        if (placement.worker_cpus[worker] >= 0) {
+          pinThread({(unsigned int)placement.worker_cpus[worker]});
+        }
+      });
+}
+
+void Mandelbrot::renderFrame(std::vector<Uint32> &pixels) {
+  startRenderThreads();
+  scheduler->resetStats();
+
+  // Nothing is kept from a buffer that hasn't held a frame yet, so its pages
+  // can be handed out to the nodes
+  if (!frame.valid) {
+    placeRows(pixels.data(), screen_width * sizeof(Uint32));
+  }
+
+  dispatchRender(pixels);
+  scheduler->wait();
+  while (dispatchNextPass()) {
+    scheduler->wait();
+  }
+  traceFrame();
+
+  dirty = false;
+}
+
+void Mandelbrot::traceFrame() {
+  if (!Trace::enabled()) {
+    return;
+  }
+
+  long long end_ns = Trace::now();
+  Trace::record("frame", frame_start_ns, end_ns, "iterations",
+                frame_iterations);
+
+  // Busy time is what the render threads spent on tiles, so the rest of
+  // the frame's wall time went on queueing, idling and the main thread
+  double wall_seconds = (end_ns - frame_start_ns) / 1e9;
+  std::vector<WorkerStats> stats = scheduler->stats();
+  double busy_seconds = 0.0;
+  for (WorkerStats const &worker : stats) {
+    busy_seconds += worker.busy_seconds;
+  }
+
+  std::cout << "Frame " << frame_number << ": " << wall_seconds * 1000.0
+            << " ms, compute " << busy_seconds * 1000.0 << " ms, threads "
+            << 100.0 * busy_seconds / (wall_seconds * stats.size())
+            << "% busy, " << frame_iterations << " iterations" << std::endl;
+}
+
+std::vector<WorkerStats> Mandelbrot::workerStats() const {
+  if (!scheduler) {
+    return {};
+  }
+  return scheduler->stats();
+}
 
+void Mandelbrot::run(Input const &Input, Renderer &renderer) {
   // start running
   running = true;
 
-  for (auto thread_index = 0; thread_index < thread_count; thread_index++) {
-    render_threads.emplace_back(
-        std::thread(&renderLoop, std::ref(queue), std::ref(running)));
+  startRenderThreads();
+  placeRows(renderer.getPixels().data(), screen_width * sizeof(Uint32));
+
+  // Pixels the render threads write are marked for the renderer to upload,
+  // and the main loop is woken as soon as they run out of work
+  dirty_rows = &renderer.getDirtyRows();
+  Uint32 idle_event = SDL_RegisterEvents(1);
+  if (idle_event != (Uint32)-1) {
+    scheduler->onIdle([idle_event] {
+      SDL_Event event{};
+      event.type = idle_event;
+      SDL_PushEvent(&event);
+    });
   }
 
   Uint32 prev_frame_end = SDL_GetTicks();
 
   while (running) {
-    Input.handleInput(*this, renderer);
+    {
+      TraceSpan span("input");
+      Input.handleInput(*this, renderer);
+    }
 
-    Uint32 frame_start = SDL_GetTicks();
+    /* A new colour scheme only needs the finished frame recoloured; a frame
+    still being computed is restarted in the new colours instead, as is one
+    whose supersampled colours would be lost */
+    if (recolour && !dirty) {
+      if (frame_in_flight || !frame.valid || antialias_samples > 0) {
+        setDirty();
+      } else {
+        auto start = std::chrono::steady_clock::now();
+        TraceSpan span("recolour");
+        recolourFrame(renderer.getPixels());
+        std::cout << "Recoloured in "
+                  << std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()
+                  << " ms" << std::endl;
+        renderer.render(selection);
+      }
+    }
+    recolour = false;
 
     if (dirty) {
       /* if the dirty flag is set, we must recalculate the colour values
       for each pixel */
+      std::string last_arithmetic = frame.valid ? arithmetic() : "";
       dispatchRender(renderer.getPixels());
-
-      Uint32 calculate_duration = SDL_GetTicks() - frame_start;
+      if (arithmetic() != last_arithmetic) {
+        std::cout << "Iterating in " << arithmetic() << std::endl;
+      }
 
       renderer.updateWindowTitle(max_iterations, x_min, x_max, y_min, y_max);
       dirty = false;
+      frame_in_flight = true;
+    }
+
+    /* Show each pass of the frame as soon as it lands, then start the next */
+    if (frame_in_flight && scheduler->idle()) {
+      renderer.render(selection);
+      prev_frame_end = SDL_GetTicks();
+
+      double since_input = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - input_time)
+                               .count();
+      if (antialias_pass) {
+        std::cout << "Anti-aliased " << antialiased_pixels << " pixels ("
+                  << 100.0 * antialiased_pixels / iterations.size()
+                  << "% of the frame) " << since_input << " ms after input"
+                  << std::endl;
+      } else if (pass_step == PROGRESSIVE_FIRST_STEP) {
+        std::cout << "First pass on screen " << since_input
+                  << " ms after input" << std::endl;
+      } else if (equalisation == Equalisation::Colouring) {
+        std::cout << "Equalised colours on screen " << since_input
+                  << " ms after input" << std::endl;
+      } else if (pass_step == 1 && (equalisation == Equalisation::None ||
+                                    equalisation == Equalisation::Rendering)) {
+        std::cout << "Frame complete " << since_input << " ms after input"
+                  << std::endl;
+        traceFrame();
+        if (deep_view && (deep_view->fallback_pixels > 0 ||
+                          deep_view->unresolved_pixels > 0)) {
+          std::cout << "Glitched pixels: " << deep_view->fallback_pixels
+                    << " iterated in double-double, "
+                    << deep_view->unresolved_pixels << " left unresolved"
+                    << std::endl;
+          renderer.updateWindowTitle(max_iterations, x_min, x_max, y_min,
+                                     y_max, deep_view->unresolved_pixels);
+        }
+      }
+
+      frame_in_flight = dispatchNextPass();
     }
 
     Uint32 current_time = SDL_GetTicks();
     Uint32 elapsed = current_time - prev_frame_end;
 
-    /* Refresh the screen periodically -- useful for showing thread progress */
-    if (elapsed > MILLISECONDS_BETWEEN_FRAMES) {
+    /* Refresh the screen periodically -- useful for showing thread progress.
+    Only the rows that changed are uploaded, and an unchanged screen isn't
+    presented at all. */
+    if (elapsed >= (Uint32)MILLISECONDS_BETWEEN_FRAMES) {
       renderer.render(selection);
       prev_frame_end = current_time;
+      elapsed = 0;
+    }
+
+    /* Sleep until an event arrives: input, or the render threads running out
+    of work. While the screen is still changing, wake for the next refresh
+    too. */
+    if (frame_in_flight || renderer.changed(selection)) {
+      SDL_WaitEventTimeout(nullptr, MILLISECONDS_BETWEEN_FRAMES - elapsed);
     } else {
-      /* Sleep main thread until next frame to minimize cpu usage */
-      SDL_Delay(MILLISECONDS_BETWEEN_FRAMES - elapsed);
+      SDL_WaitEvent(nullptr);
     }
   }
+
+  // Stop the render threads touching the renderer before it goes away
+  generation++;
+  dropped_jobs += scheduler->clear();
+  scheduler->wait();
+  scheduler->onIdle(nullptr);
+  dirty_rows = nullptr;
+
+  if (tile_cache) {
+    TileCacheStats stats = tile_cache->stats();
+    std::cout << "Tile cache: " << stats.hits << " hits, " << stats.misses
+              << " misses, " << stats.entries << " tiles ("
+              << (stats.bytes >> 20) << " MB) held" << std::endl;
+  }
+
+  std::cout << "Cancelled tiles: " << dropped_jobs
+            << " dropped from the queue, " << aborted_jobs
+            << " stopped part-way" << std::endl;
+}
+
+FrameState Mandelbrot::currentFrameState() const {
+  FrameState state;
+  state.valid = true;
+  state.center_x = center_x;
+  state.center_y = center_y;
+  state.zoom = zoom;
+  state.x_range = x_range;
+  state.y_range = y_range;
+  state.max_iterations = max_iterations;
+  state.colour_scheme_id = colour_scheme_id;
+  state.colouring = colouring;
+  state.kernel = kernel;
+  state.fractal = fractal;
+  state.shortcuts = shortcuts;
+  state.mode = mode;
+  state.antialias_samples = antialias_samples;
+  return state;
+}
+
+std::vector<Tile> Mandelbrot::reuseFrame(std::vector<Uint32> &pixels,
+                                         bool previous_complete,
+                                         unsigned int &resume_from) {
+  FrameState next = currentFrameState();
+  FrameState previous = frame;
+  frame = next;
+
+  std::vector<Tile> everything{Tile{0, 0, screen_width, screen_height}};
+  resume_from = 0;
+
+  // Only a finished frame of the same picture is worth reusing
+  if (!previous_complete || !sameContent(previous, next)) {
+    return everything;
+  }
+
+  // A raised limit on the same view carries on the orbits that ran out
+  if (previous.max_iterations != max_iterations) {
+    if (orbits_valid && previous.max_iterations < max_iterations &&
+        previous.zoom == zoom &&
+        (previous.center_x - center_x).toDouble() == 0.0 &&
+        (previous.center_y - center_y).toDouble() == 0.0) {
+      resume_from = previous.max_iterations;
+    }
+    return everything;
+  }
+
+  // Zooms: show the old frame stretched while the new one is computed
+  if (previous.zoom != zoom) {
+    reprojectPixels(pixels, screen_width, screen_height, previous, next,
+                    (Uint32)0xff000000);
+    reprojectPixels(iterations, screen_width, screen_height, previous, next,
+                    max_iterations);
+    if (dirty_rows) {
+      dirty_rows->markAll();
+    }
+    return everything;
+  }
+
+  // Pans: shift the old frame and compute only the strips it uncovers
+  double dx = zoom * x_range / screen_width;
+  double dy = zoom * y_range / screen_height;
+  double exact_x = (center_x - previous.center_x).toDouble() / dx;
+  double exact_y = (center_y - previous.center_y).toDouble() / dy;
+  int shift_x = (int)std::round(exact_x);
+  int shift_y = (int)std::round(exact_y);
+
+  if (std::abs(exact_x - shift_x) > 1e-3 ||
+      std::abs(exact_y - shift_y) > 1e-3 ||
+      std::abs(shift_x) >= (int)screen_width ||
+      std::abs(shift_y) >= (int)screen_height) {
+    return everything;
+  }
+
+  shiftPixels(pixels, screen_width, screen_height, shift_x, shift_y);
+  shiftPixels(iterations, screen_width, screen_height, shift_x, shift_y);
+  if (orbits_valid) {
+    shiftPixels(orbit_r, screen_width, screen_height, shift_x, shift_y);
+    shiftPixels(orbit_i, screen_width, screen_height, shift_x, shift_y);
+  }
+  if (dirty_rows) {
+    dirty_rows->markAll();
+  }
+
+  std::vector<Tile> strips;
+  unsigned int columns = std::abs(shift_x);
+  unsigned int rows = std::abs(shift_y);
+
+  // Uncovered columns, full height
+  if (shift_x > 0) {
+    strips.push_back(
+        Tile{screen_width - columns, 0, screen_width, screen_height});
+  } else if (shift_x < 0) {
+    strips.push_back(Tile{0, 0, columns, screen_height});
+  }
+
+  // Uncovered rows, minus the corner the columns already cover
+  unsigned int row_x0 = shift_x < 0 ? columns : 0;
+  unsigned int row_x1 = shift_x > 0 ? screen_width - columns : screen_width;
+  if (shift_y > 0) {
+    strips.push_back(
+        Tile{row_x0, screen_height - rows, row_x1, screen_height});
+  } else if (shift_y < 0) {
+    strips.push_back(Tile{row_x0, 0, row_x1, rows});
+  }
+
+  return strips;
 }
 
 void Mandelbrot::dispatchRender(std::vector<Uint32> &pixels) {
+  TraceSpan span("dispatch");
+
+  // Only if the render threads got through all of the previous frame, down
+  // to its last pass, is it known to be in the buffer. A frame whose
+  // anti-aliasing or equalisation never ran isn't, or the part of it that
+  // is reused would never get them.
+  bool previous_complete = scheduler->idle() && frame_finished;
+  frame_finished = false;
+
+  // Drop the queued jobs of the previous frame, and have the ones already
+  // running stop at their next row. Once they have, nothing but this
+  // frame's jobs writes to the buffers.
+  auto options = std::make_shared<RenderOptions>(RenderOptions{pixels});
+  options->generation = ++generation;
+  options->current_generation = &generation;
+  options->dirty_rows = dirty_rows;
+  dropped_jobs += scheduler->clear();
+  scheduler->wait();
+
+  if (Trace::enabled()) {
+    frame_number++;
+    frame_start_ns = Trace::now();
+    frame_iterations = 0;
+    scheduler->resetStats();
+  }
+  options->max_iterations = max_iterations;
+  options->screen_width = screen_width;
+  options->screen_height = screen_height;
+  options->palette = framePalette();
+  options->fractal = fractal;
+  options->shortcuts = shortcuts;
+  // Only the Mandelbrot formula maps c and its conjugate to mirrored orbits
+  if (!fractal.hasRealSymmetry()) {
+    options->shortcuts.symmetry = false;
+  }
+  options->mode = mode;
+  options->x_min = x_min;
+  options->x_max = x_max;
+  options->y_min = y_min;
+  options->y_max = y_max;
+
+  if (iterations.size() != screen_width * screen_height) {
+    iterations.resize(screen_width * screen_height);
+    placeRows(iterations.data(), screen_width * sizeof(unsigned int));
+  }
+  options->iterations = &iterations[0];
+
+  unsigned int resume_from;
+  std::vector<Tile> regions =
+      reuseFrame(pixels, previous_complete, resume_from);
+
+  // Pixels are iterated in the fastest precision that resolves them, except
+  // that past the precision of a double every pixel of z^2 + c is iterated
+  // as a delta from one high-precision orbit at the view center, which is
+  // faster still. The other families run out of precision past
+  // double-double.
+  double pixel_spacing = zoom * x_range / screen_width;
+  precision =
+      forced_precision.value_or(precisionFor(pixel_spacing, max_iterations));
+  deep_view.reset();
+  if (!forced_precision && pixel_spacing < DEEP_ZOOM_PIXEL_SPACING &&
+      fractal.isMandelbrot()) {
+    deep_view = prepareDeepView();
+    options->deep = deep_view;
+    precision = Precision::Double;
+  }
+  if (precision == Precision::Float && max_iterations >= FLOAT_MAX_ITERATIONS) {
+    precision = Precision::Double;
+  }
+  options->precision = precision;
+  options->kernel = getKernel(kernel_type, fractal, precision);
+
+  // Double-double frames get their corner to full precision, and their
+  // pixel spacing from the zoom
+  if (precision == Precision::DoubleDouble) {
+    options->x_min_lo = (center_x - BigFloat(zoom * (x_range / 2.0)) -
+                         BigFloat(x_min))
+                            .toDouble();
+    options->y_min_lo = (center_y - BigFloat(zoom * (y_range / 2.0)) -
+                         BigFloat(y_min))
+                            .toDouble();
+    options->dx = pixel_spacing;
+    options->dy = zoom * y_range / screen_height;
+    options->shortcuts.symmetry = false;
+  }
+
+  // Pixels of the reused part next to the strips a pan uncovers may only
+  // now have a neighbour that differs, so anti-aliasing takes in a pixel of
+  // it around them. The row strip is trimmed back off the column strip, so
+  // that no pixel is refined twice.
+  antialias_regions = regions;
+  for (Tile &tile : antialias_regions) {
+    tile.x0 = tile.x0 > 0 ? tile.x0 - 1 : 0;
+    tile.y0 = tile.y0 > 0 ? tile.y0 - 1 : 0;
+    tile.x1 = std::min(tile.x1 + 1, screen_width);
+    tile.y1 = std::min(tile.y1 + 1, screen_height);
+  }
+  if (antialias_regions.size() == 2) {
+    Tile const &columns = antialias_regions[0];
+    Tile &rows = antialias_regions[1];
+    if (columns.x0 == 0) {
+      rows.x0 = std::max(rows.x0, columns.x1);
+    } else {
+      rows.x1 = std::min(rows.x1, columns.x0);
+    }
+  }
+
+  // Tiles already computed for this lattice needn't be computed again
+  if (resume_from == 0) {
+    regions = useCache(*options, regions);
+  }
+
+  bool whole_frame = regions.size() == 1 &&
+                     regions[0].x1 - regions[0].x0 == screen_width &&
+                     regions[0].y1 - regions[0].y0 == screen_height;
+
+  // Orbits that run out of iterations are kept while they fit the budget,
+  // for a raised limit to carry on. Subdivision fills pixels it never
+  // iterates, perturbation iterates deltas and double-double orbits don't
+  // fit in doubles, so none of them keeps them.
+  bool keep_orbits =
+      2 * sizeof(double) * iterations.size() <= resume_memory &&
+      mode == RenderMode::BruteForce && !beyondDouble(*options);
+  if (keep_orbits) {
+    if (orbit_r.size() != iterations.size()) {
+      orbit_r.resize(iterations.size());
+      orbit_i.resize(iterations.size());
+      placeRows(orbit_r.data(), screen_width * sizeof(double));
+      placeRows(orbit_i.data(), screen_width * sizeof(double));
+    }
+    options->orbit_r = &orbit_r[0];
+    options->orbit_i = &orbit_i[0];
+    // Pans only fill in strips, so they are only complete if the shifted
+    // orbits were
+    orbits_valid = whole_frame || orbits_valid;
+  } else {
+    orbit_r = std::vector<double>();
+    orbit_i = std::vector<double>();
+    orbits_valid = false;
+    resume_from = 0;
+  }
+
+  // Carrying on orbits needs no passes, and every row has its own orbits
+  options->resume_from = resume_from;
+  if (resume_from > 0) {
+    options->shortcuts.symmetry = false;
+  }
+
+  // Mirrored rows could land in the reused part of the frame
+  if (!whole_frame) {
+    options->shortcuts.symmetry = false;
+  }
+
+  // Subdivision works on whole rectangles rather than rows, so it neither
+  // mirrors rows nor refines in passes
+  if (mode == RenderMode::Subdivide) {
+    options->shortcuts.symmetry = false;
+  }
+
+  // Whole frames are worth refining in passes; the strips left by a pan
+  // are quick enough to compute in one go. Rows of a pass needn't mirror
+  // onto rows of the same pass, so passes don't use symmetry.
+  pass_step = 1;
+  if (progressive && whole_frame && mode != RenderMode::Subdivide &&
+      resume_from == 0) {
+    pass_step = PROGRESSIVE_FIRST_STEP;
+    options->step = pass_step;
+    options->shortcuts.symmetry = false;
+  }
+
+  antialias_pass = false;
+  antialiased_pixels = 0;
+  equalisation = Equalisation::None;
+
+  // Equalised frames count their pixels as their last pass computes them,
+  // if that pass covers them all; pans, cache hits and subdivision's filled
+  // rectangles leave pixels it doesn't, which get a pass of their own
+  if (colouring == Colouring::Histogram && !fixed_histogram && whole_frame &&
+      (mode != RenderMode::Subdivide || beyondDouble(*options))) {
+    resetWorkerHistograms();
+    options->histograms = &worker_histograms;
+    equalisation = Equalisation::Rendering;
+  }
+
+  pass_options = options;
+  pass_regions = regions;
+  submitTiles(options, regions);
+}
+
+std::vector<Tile> Mandelbrot::useCache(RenderOptions &options,
+                                       std::vector<Tile> const &regions) {
+  // Views beyond a double and subdivision's filled rectangles aren't cached
+  if (!tile_cache || beyondDouble(options) || mode == RenderMode::Subdivide) {
+    return regions;
+  }
 
-  // clear any pending render tasks
-  queue.clear();
-
-  // Split screen pixels into equally-sized chunks and get threads to
-  // recalculate
-  for (unsigned int i = 0; i < thread_count; i++) {
-    RenderOptions r{pixels};
-    r.offset = i;
-    r.skip_count = thread_count;
-    r.max_iterations = max_iterations;
-    r.screen_width = screen_width;
-    r.screen_height = screen_height;
-    r.colouring_function = colourFunctions[colour_scheme_id];
-    r.x_min = x_min;
-    r.x_max = x_max;
-    r.y_min = y_min;
-    r.y_max = y_max;
-    queue.send(std::move(r));
+  // Only views a whole number of pixels from the anchor are on its lattice
+  double dx = zoom * x_range / screen_width;
+  double dy = zoom * y_range / screen_height;
+  double offset_x = (center_x - anchor_x).toDouble() / dx;
+  double offset_y = (center_y - anchor_y).toDouble() / dy;
+  if (std::abs(offset_x - std::round(offset_x)) > 1e-3 ||
+      std::abs(offset_y - std::round(offset_y)) > 1e-3) {
+    return regions;
   }
+
+  options.cache = tile_cache.get();
+  options.lattice_x = std::llround(offset_x) - screen_width / 2;
+  options.lattice_y = std::llround(offset_y) - screen_height / 2;
+
+  TileKey &key = options.cache_key;
+  key.zoom = zoom;
+  key.x_range = x_range;
+  key.y_range = y_range;
+  key.screen_width = screen_width;
+  key.screen_height = screen_height;
+  key.anchor_x = anchor_x.toDouble();
+  key.anchor_y = anchor_y.toDouble();
+  key.tile_size = tile_size;
+  key.max_iterations = max_iterations;
+  key.fractal = fractal;
+  key.cardioid_check = shortcuts.cardioid;
+  key.periodicity_check = shortcuts.periodicity;
+
+  std::vector<Tile> misses;
+  bool hit = false;
+  for (Tile const &region : regions) {
+    for (Tile const &tile : splitOnLattice(region, tile_size, options)) {
+      TileKey tile_key;
+      unsigned int *counts =
+          &options.iterations[screen_width * tile.y0 + tile.x0];
+      if (cacheKey(options, tile, tile_key) &&
+          tile_cache->lookup(tile_key, counts, screen_width)) {
+        for (unsigned int j = tile.y0; j < tile.y1; j++) {
+          unsigned int offset = screen_width * j + tile.x0;
+          colourPixels(options, &options.iterations[offset],
+                       &options.pixels[offset], tile.x1 - tile.x0);
+        }
+        markTile(options, tile);
+        hit = true;
+      } else {
+        misses.push_back(tile);
+      }
+    }
+  }
+
+  if (!hit) {
+    return regions;
+  }
+
+  // The cache keeps counts but not orbits
+  orbits_valid = false;
+  return misses;
+}
+
+bool Mandelbrot::dispatchNextPass() {
+  if (pass_step == 1) {
+    // Once the frame is complete, its colours are equalised (unless the
+    // histogram is fixed) before anything is averaged from them
+    if (colouring == Colouring::Histogram && !fixed_histogram &&
+        equalisation != Equalisation::Colouring && !antialias_pass) {
+      dispatchEqualisation();
+      return true;
+    }
+
+    // Then supersample its edges. Views beyond a double would need their
+    // samples perturbed from the reference or placed in double-double, so
+    // they go without.
+    if (antialias_samples == 0 || antialias_pass ||
+        beyondDouble(*pass_options)) {
+      frame_finished = true;
+      return false;
+    }
+
+    auto options = std::make_shared<RenderOptions>(*pass_options);
+    options->step = 1;
+    options->colour_only = false;
+    options->antialias = antialias_samples;
+    antialias_pass = true;
+
+    pass_options = options;
+    submitTiles(options, antialias_regions);
+    return true;
+  }
+
+  // Each pass halves the step and fills in between the samples so far
+  auto options = std::make_shared<RenderOptions>(*pass_options);
+  pass_step /= 2;
+  options->step = pass_step;
+  options->first_pass = false;
+
+  pass_options = options;
+  submitTiles(options, pass_regions);
+  return true;
+}
+
+void Mandelbrot::resetWorkerHistograms() {
+  // The histograms keep their memory from frame to frame
+  worker_histograms.resize(thread_count);
+  for (std::vector<unsigned int> &histogram : worker_histograms) {
+    histogram.assign(escapedBins(max_iterations) + 1, 0);
+  }
+}
+
+void Mandelbrot::dispatchEqualisation() {
+  auto options = std::make_shared<RenderOptions>(*pass_options);
+
+  if (equalisation == Equalisation::None) {
+    // Each render thread counts into a histogram of its own, so they never
+    // contend for one
+    resetWorkerHistograms();
+    options->histograms = &worker_histograms;
+    options->count_only = true;
+    equalisation = Equalisation::Counting;
+    pass_options = options;
+    submitTiles(options, {Tile{0, 0, screen_width, screen_height}});
+    return;
+  }
+
+  if (equalisation != Equalisation::Merging) {
+    // The render threads merge the histograms, each summing a range of bins
+    // over all of them
+    options->histograms = &worker_histograms;
+    options->count_only = false;
+    options->merge_only = true;
+    equalisation = Equalisation::Merging;
+    pass_options = options;
+
+    unsigned int bins = worker_histograms[0].size();
+    unsigned int ranges = std::min(thread_count, bins);
+    std::vector<RenderJob> jobs;
+    for (unsigned int k = 0; k < ranges; k++) {
+      jobs.push_back(RenderJob{
+          options, Tile{bins * k / ranges, 0, bins * (k + 1) / ranges, 1}});
+    }
+    scheduler->submit(std::move(jobs));
+    return;
+  }
+
+  colour_histogram = worker_histograms[0];
+  options->histograms = nullptr;
+  options->merge_only = false;
+  options->colour_only = true;
+  options->palette = buildEqualisedPalette(colourFunctions[colour_scheme_id],
+                                           colour_histogram,
+                                           options->max_iterations);
+  equalisation = Equalisation::Colouring;
+  pass_options = options;
+  submitTiles(options, {Tile{0, 0, screen_width, screen_height}});
+
+  // Recolouring undoes the anti-aliasing of any part of the frame reused
+  antialias_regions.assign(1, Tile{0, 0, screen_width, screen_height});
+}
+
+void Mandelbrot::submitTiles(
+    std::shared_ptr<RenderOptions const> const &options,
+    std::vector<Tile> const &regions) {
+  // Split the regions into small tiles for the render threads. Coarse
+  // passes use bigger tiles, so that a tile still has about as many samples
+  // per row as the kernels have lanes to fill.
+  unsigned int edge = tile_size * options->step;
+  if (options->mode == RenderMode::Subdivide && !beyondDouble(*options)) {
+    edge *= SUBDIVISION_TILE_SCALE;
+  }
+
+  // Cutting along the frame's lattice keeps whole tiles in one piece, so
+  // that they can be cached
+  long long queued = Trace::enabled() ? Trace::now() : -1;
+  std::vector<RenderJob> jobs;
+  for (Tile const &region : regions) {
+    for (Tile const &tile : splitOnLattice(region, edge, *options)) {
+      jobs.push_back(RenderJob{options, tile, false, queued});
+    }
+  }
+
+  // Each group computes the tiles of its own band, whose pages are on its
+  // node (tiles across a boundary go by their middle row)
+  if (placement.groupCount() < 2) {
+    scheduler->submit(std::move(jobs));
+    return;
+  }
+  scheduler->submit(std::move(jobs), [this](RenderJob const &job) {
+    unsigned int row = (job.tile.y0 + job.tile.y1) / 2;
+    return (unsigned int)(std::upper_bound(band_starts.begin() + 1,
+                                           band_starts.end(), row) -
+                          (band_starts.begin() + 1));
+  });
+}
+
+std::shared_ptr<DeepView const> Mandelbrot::prepareDeepView() {
+  auto view = std::make_shared<DeepView>();
+  view->center_x = center_x;
+  view->center_y = center_y;
+  view->dx = zoom * x_range / screen_width;
+  view->dy = zoom * y_range / screen_height;
+  view->half_x = zoom * (x_range / 2.0);
+  view->half_y = zoom * (y_range / 2.0);
+  view->fraction_limbs = std::max(
+      {BigFloat::precisionFor(std::min(view->dx, view->dy)),
+       center_x.precision(), center_y.precision()});
+  view->kernel = perturbation_kernel;
+
+  // Pixels that stay glitched are iterated in double-double, while it still
+  // resolves them
+  if (std::min(view->dx, view->dy) >= DOUBLE_DOUBLE_PIXEL_SPACING) {
+    BigFloat x0 = center_x + BigFloat(-view->half_x);
+    view->fallback = getKernel(kernel_type, fractal, Precision::DoubleDouble);
+    view->fallback_row.x0 = x0.toDouble();
+    view->fallback_row.x0_lo = (x0 - BigFloat(view->fallback_row.x0))
+                                   .toDouble();
+    view->fallback_row.dx = view->dx;
+    view->fallback_row.cardioid_check = shortcuts.cardioid;
+    view->fallback_row.periodicity_check = shortcuts.periodicity;
+  }
+
+  std::shared_ptr<ReferenceOrbit> reference =
+      choosePrimaryReference(*view, max_iterations);
+  computeSeriesApproximation(*reference, view->half_x, view->half_y,
+                             std::min(view->dx, view->dy), max_iterations);
+  view->reference = reference;
+
+  return view;
 }
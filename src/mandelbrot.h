@@ -2,28 +2,104 @@
 #define MANDELBROT_H
 
 #include "SDL.h"
+#include "big_float.h"
+#include "dirty_rows.h"
 #include "input.h"
-#include "message_queue.h"
+#include "kernels.h"
+#include "perturbation.h"
+#include "progressive.h"
 #include "renderer.h"
+#include "tile_cache.h"
+#include "tile_scheduler.h"
+#include "topology.h"
+#include <atomic>
+#include <chrono>
 #include <future>
+#include <optional>
 #include <random>
 
 // forward declaration for use in function signature
 class Input;
 
-/** A RenderOptions object contains information for redrawing a region of the
- * image on the canvas.
- * The strategy taken is for each thread (for n threads) to compute only rows
- * of pixels given by k*n + r, where r is in range 0..n-1.
- * This splits the work out very evenly and also results in a cool interlacing
- * effect when something goes wrong.
+/** Shortcuts that avoid iterating points inside the set all the way to
+ * max_iterations. Each can be switched off to measure its speedup.
+ */
+struct Shortcuts {
+  bool cardioid{true};    /* analytic main cardioid / period-2 bulb test */
+  bool periodicity{true}; /* Brent-style cycle detection */
+  bool symmetry{true};    /* mirror rows across the real axis */
+};
+
+/** How the render threads cover a tile */
+enum class RenderMode {
+  BruteForce, /* iterate every pixel */
+  Subdivide   /* Mariani-Silver: trace rectangle borders, fill uniform ones */
+};
+
+std::string renderModeName(RenderMode mode);
+// Looks up a mode by name; returns false if there is no such mode
+bool parseRenderMode(std::string const &name, RenderMode &mode);
+
+/** How iteration counts are mapped onto the colour scheme */
+enum class Colouring {
+  Linear,   /* by count / max_iterations */
+  Histogram /* by the share of the frame's pixels with lower counts */
+};
+
+std::string colouringName(Colouring colouring);
+// Looks up a colouring by name; returns false if there is no such colouring
+bool parseColouring(std::string const &name, Colouring &colouring);
+
+/** A RenderOptions object contains information for redrawing the image on
+ * the canvas. It is shared by all the RenderJobs of one frame.
  */
 struct RenderOptions {
   std::vector<Uint32> &pixels; /* pixels to update */
-  unsigned int offset;         /* which rows to render */
-  unsigned int skip_count;     /* how many rows to skip between rendered rows */
   unsigned int max_iterations; /* Maximum number of iterations */
-  Uint32 (*colouring_function)(double f); /* Colouring function */
+  /* Colour of each iteration count, 0 to max_iterations */
+  std::shared_ptr<std::vector<Uint32> const> palette;
+  RowKernel kernel;                     /* Escape-time kernel */
+  Precision precision;                  /* What the kernel iterates in */
+  Fractal fractal;                      /* Family the kernel computes */
+  Shortcuts shortcuts;                  /* Interior shortcuts to apply */
+  RenderMode mode;                      /* How tiles are covered */
+  unsigned int *iterations;             /* Iteration counts of the frame */
+  /* Orbits of the frame's pixels that ran out of iterations, if kept */
+  double *orbit_r;
+  double *orbit_i;
+  /* If nonzero, only carry on the orbits that ran out at this limit */
+  unsigned int resume_from;
+  /* Cache for finished tiles (if set), with the key of this frame's tiles */
+  TileCache *cache;
+  TileKey cache_key;
+  /* Lattice position of pixel (0, 0); tiles are cut at multiples of the
+     tile size on the lattice */
+  long long lattice_x;
+  long long lattice_y;
+  /* Number of the frame these options belong to, and of the frame being
+     rendered now; once they differ the frame is abandoned */
+  unsigned long generation;
+  std::atomic<unsigned long> const *current_generation;
+  std::shared_ptr<DeepView const> deep; /* Set for perturbation renders */
+  DirtyRows *dirty_rows; /* Where to mark the pixels written, if set */
+  /* Progressive pass: every step-th pixel of every step-th row, each filling
+     the step x step block it starts (1 for a full-resolution render) */
+  unsigned int step{1};
+  bool first_pass{true}; /* false if a coarser pass already ran */
+  /* Anti-aliasing pass: if nonzero, supersample the pixels whose count
+     differs sharply from a neighbour's on an antialias x antialias grid */
+  unsigned int antialias{0};
+  /* Histogram colouring: if set, the full-resolution pass counts the
+     iterations of the pixels it completes, each render thread into its own
+     histogram of binned counts, (*histograms)[worker] */
+  std::vector<std::vector<unsigned int>> *histograms{nullptr};
+  /* Histogram pass: only count the pixels of the tiles, computing nothing */
+  bool count_only{false};
+  /* Merge pass: add bins tile.x0 to tile.x1 of the other histograms to the
+     first's */
+  bool merge_only{false};
+  /* Colour pass: recolour the pixels from their counts with the palette */
+  bool colour_only{false};
   /* Dimensions on screen in pixels */
   unsigned int screen_width;
   unsigned int screen_height;
@@ -32,14 +108,61 @@ struct RenderOptions {
   double x_max;
   double y_min;
   double y_max;
+  /* Double-double frames: the parts of x_min and y_min a double misses, and
+     the pixel spacing, which the difference of bounds this close together
+     no longer gives */
+  double x_min_lo{0.0};
+  double y_min_lo{0.0};
+  double dx{0.0};
+  double dy{0.0};
+};
+
+/** A RenderJob is one tile of a frame for a render thread to compute.
+ * The strategy taken is to cut the frame into small tiles which are dealt out
+ * to the render threads; threads that run out of tiles steal from the others,
+ * so cheap and expensive regions of the image balance out.
+ */
+struct RenderJob {
+  std::shared_ptr<RenderOptions const> options;
+  Tile tile;
+  /* Subdivision: the tile's border is already in options.iterations */
+  bool border_known{false};
+  /* When the job was queued, if tracing */
+  long long queued_ns{-1};
+};
+
+/** Render jobs given up on because a newer frame replaced theirs */
+struct CancelStats {
+  unsigned long dropped{0}; /* still queued, never started */
+  unsigned long aborted{0}; /* stopped part-way through */
+};
+
+/** A FrameState records which view the pixel buffer shows (or will show once
+ * the render threads finish), so that the next frame can reuse it.
+ */
+struct FrameState {
+  bool valid{false};
+  BigFloat center_x;
+  BigFloat center_y;
+  double zoom;
+  double x_range;
+  double y_range;
+  unsigned int max_iterations;
+  unsigned int colour_scheme_id;
+  Colouring colouring;
+  RowKernel kernel;
+  Fractal fractal;
+  Shortcuts shortcuts;
+  RenderMode mode;
+  unsigned int antialias_samples;
 };
 
 class Mandelbrot {
 public:
   Mandelbrot(unsigned int screen_width, unsigned int screen_height,
-             unsigned int thread_count)
+             unsigned int thread_count, unsigned int tile_size = 32)
       : screen_width(screen_width), screen_height(screen_height),
-        thread_count(thread_count) {
+        thread_count(thread_count), tile_size(tile_size) {
     resetBounds();
   };
   ~Mandelbrot();
@@ -60,50 +183,274 @@ public:
   void increaseIterations();
   void decreaseIterations();
   void nextColourScheme();
+  // switch between linear and histogram-equalised colouring
+  void toggleColouring();
+  // switch to the Julia set of the point under the mouse, or back from it
+  // to the view it was picked in
+  void toggleJulia();
+
+  void setCenter(double x, double y);
+  void setCenter(BigFloat const &x, BigFloat const &y);
+  void setZoom(double new_zoom);
+  void setBounds(double new_x_min, double new_x_max, double new_y_min,
+                 double new_y_max);
+  // narrow the view to the screen-sized rectangle at (x0, y0) of itself
+  // drawn full_width x full_height, for rendering an image piece by piece
+  void cropTo(unsigned int full_width, unsigned int full_height,
+              unsigned int x0, unsigned int y0);
+  void setIterations(unsigned int iterations);
+  void setColourScheme(unsigned int id);
+  void setColouring(Colouring new_colouring);
+  // equalise every frame with this histogram (as colourHistogram() gives
+  // it) rather than with its own, so that pieces of one image match
+  void setColourHistogram(std::vector<unsigned int> const &histogram);
+  void setKernel(KernelType type);
+  // number format to iterate in, or none to pick the fastest that resolves
+  // the pixels of each frame
+  void setPrecision(std::optional<Precision> forced);
+  // fractal family to render; resets the view if the family changes
+  void setFractal(Fractal const &new_fractal);
+  void setShortcuts(Shortcuts new_shortcuts);
+  void setProgressive(bool enabled);
+  void setRenderMode(RenderMode new_mode);
+  // supersample edge pixels on a samples x samples grid (below 2 to not)
+  void setAntialias(unsigned int samples);
+  // memory the orbits of unfinished pixels may take (0 to not keep them)
+  void setResumeMemory(size_t bytes);
+  // memory the tile cache may take (0 to not cache tiles)
+  void setCacheMemory(size_t bytes);
+  // where the render threads run, and how many there are; only takes
+  // effect if set before the first frame starts them
+  void setPlacement(ThreadPlacement const &new_placement);
+
+  // method: render the current view into pixels, blocking until it is done
+  void renderFrame(std::vector<Uint32> &pixels);
+  // iteration counts of the last frame rendered
+  std::vector<unsigned int> const &iterationCounts() const {
+    return iterations;
+  }
+  // colour iteration counts in the current scheme and iteration limit (and
+  // equalised by their own histogram, with histogram colouring)
+  void colourCounts(std::vector<unsigned int> const &counts,
+                    std::vector<Uint32> &pixels) const;
+  // histogram of the last frame's counts, which it was equalised with: a bin
+  // per escaped count (or, past a few thousand, per run of counts) and one
+  // for the pixels that never escaped
+  std::vector<unsigned int> const &colourHistogram() const {
+    return colour_histogram;
+  }
+  // per-thread busy time and job counts since the last renderFrame
+  std::vector<WorkerStats> workerStats() const;
+  // reference orbit of the last frame, if it was rendered by perturbation
+  std::shared_ptr<DeepView const> deepView() const { return deep_view; }
+  // what the last frame was iterated in: a precision, or perturbation
+  std::string arithmetic() const;
+  // tile cache lookups so far
+  TileCacheStats cacheStats() const;
+  // render jobs cancelled so far
+  CancelStats cancelStats() const;
+  // size of the view on the complex plane at zoom 1
+  double xRange() const { return x_range; }
+  double yRange() const { return y_range; }
+  // pixels the last frame's anti-aliasing pass supersampled
+  unsigned long antialiasedPixels() const { return antialiased_pixels; }
 
 private:
   // number of available threads
   unsigned int thread_count;
+  // the CPU and group of each render thread; each group computes the tiles
+  // of its own band of rows, band_starts[g] to band_starts[g + 1], and the
+  // buffers' pages for those rows are first touched by its threads
+  ThreadPlacement placement;
+  std::vector<unsigned int> band_starts;
+  // edge length of the square tiles handed to render threads
+  unsigned int tile_size;
 
   // screen size
   unsigned int screen_width;
   unsigned int screen_height;
 
-  // bounds in the complex plane
+  // bounds in the complex plane; the center is kept at full precision for
+  // deep zooms, the bounds are only approximations
   double x_range = 3.0;
   double y_range = 2.5;
-  double center_x = -1.0;
-  double center_y = 0.0;
+  BigFloat center_x{-1.0};
+  BigFloat center_y{0.0};
   double x_min = -2.5;
   double x_max = 0.5;
   double y_min = -1.25;
   double y_max = 1.25;
   double zoom = 1.0;
 
-  // rendering threads
-  std::vector<std::thread> render_threads;
-  // queue for tasking render threads
-  MessageQueue<RenderOptions> queue;
+  // zoom is kept to levels zoom_base * ZOOM_STEP^zoom_level, and the pixel
+  // lattice of each level is anchored at the center the view had when the
+  // level was set, so that views can be revisited exactly
+  double zoom_base = 1.0;
+  int zoom_level = 0;
+  BigFloat anchor_x{-1.0};
+  BigFloat anchor_y{0.0};
+  // finished tiles, looked up before any work is queued
+  std::unique_ptr<TileCache> tile_cache{
+      std::make_unique<TileCache>(size_t(128) << 20)};
+  // bumped when each frame is dispatched; jobs of older frames notice
+  // between rows and stop
+  std::atomic<unsigned long> generation{0};
+  std::atomic<unsigned long> dropped_jobs{0};
+  std::atomic<unsigned long> aborted_jobs{0};
+
+  // with tracing on: when the current frame was dispatched, and the
+  // iterations its tiles have computed so far
+  unsigned long frame_number{0};
+  long long frame_start_ns{0};
+  std::atomic<unsigned long long> frame_iterations{0};
+
+  // rows of the renderer's pixels changed since it last drew them, while
+  // run() is drawing to a window
+  DirtyRows *dirty_rows{nullptr};
+
+  // rendering threads, tasked with tiles of the image
+  std::unique_ptr<TileScheduler<RenderJob>> scheduler;
 
   // maximum iterations
   unsigned int max_iterations = 50;
   // current colour scheme
   unsigned int colour_scheme_id = 0;
+  // how counts map onto it; with histogram colouring, the per-thread
+  // histograms of the last frame counted and the frame's merged histogram
+  // (which the next frame is previewed with too), and whether that was set
+  // from outside and is kept for every frame
+  Colouring colouring{Colouring::Linear};
+  std::vector<std::vector<unsigned int>> worker_histograms;
+  std::vector<unsigned int> colour_histogram;
+  bool fixed_histogram{false};
+  // fractal family, and the escape-time kernel compiled for it that the
+  // render threads use
+  Fractal fractal;
+  KernelType kernel_type = detectKernel();
+  RowKernel kernel = getKernel(kernel_type, fractal);
+  PerturbationKernel perturbation_kernel =
+      getPerturbationKernel(detectKernel());
+  // number format forced on every frame, and the one the last frame used
+  std::optional<Precision> forced_precision;
+  Precision precision{Precision::Double};
+  // view description for the last deep-zoom frame
+  std::shared_ptr<DeepView const> deep_view;
+  // what the pixel buffer holds
+  FrameState frame;
+  // interior shortcuts used by the render threads
+  Shortcuts shortcuts;
+  // how the render threads cover their tiles
+  RenderMode mode{RenderMode::BruteForce};
+  // raw iteration counts of the frame, which the pixels are coloured from
+  std::vector<unsigned int> iterations;
+  // z of every pixel that ran out of iterations, so that raising the limit
+  // can carry on from there; kept while it fits in resume_memory
+  size_t resume_memory{64 << 20};
+  std::vector<double> orbit_r;
+  std::vector<double> orbit_i;
+  // flag for the orbits matching the frame in the buffer
+  bool orbits_valid{false};
+  // compute frames coarse-to-fine in passes, showing each as it lands
+  bool progressive{false};
+  // step of the last pass dispatched (1 once the full-resolution pass is)
+  unsigned int pass_step{1};
+  // true once the last frame dispatched has been through all its passes,
+  // anti-aliasing and equalisation included, so it can be reused as it is
+  bool frame_finished{false};
+  // supersampling grid of the anti-aliasing pass (0 for none), and whether
+  // it is the last pass dispatched
+  unsigned int antialias_samples{0};
+  bool antialias_pass{false};
+  // how far histogram colouring of the current frame has got: its passes
+  // are counting its pixels as they compute them, or it is being counted
+  // after them, or the counts are being merged, or it is being recoloured
+  enum class Equalisation {
+    None,
+    Rendering,
+    Counting,
+    Merging,
+    Colouring
+  } equalisation{};
+  // regions of the buffer the current frame fills, computed or from the
+  // cache, and a pixel into what it reused around them, which the
+  // anti-aliasing pass goes over
+  std::vector<Tile> antialias_regions;
+  std::atomic<unsigned long> antialiased_pixels{0};
+  // the last pass dispatched, for building the next, finer one
+  std::shared_ptr<RenderOptions const> pass_options;
+  std::vector<Tile> pass_regions;
+  // when the input that made the current frame dirty arrived
+  std::chrono::steady_clock::time_point input_time;
 
   // selection rectangle
   SDL_Rect selection{0, 0, 0, 0};
+  // where the mouse was last seen, for picking Julia sets
+  int mouse_x{0};
+  int mouse_y{0};
+  // the family and view a Julia set was picked from, to go back to
+  Fractal julia_parent;
+  BigFloat julia_parent_x{-1.0};
+  BigFloat julia_parent_y{0.0};
+  double julia_parent_zoom{1.0};
 
   // flag for if still running
-  bool running;
+  bool running{false};
   // flag for redraw on next frame;
   bool dirty;
   // flag for mouse dragging
   bool dragging{false};
+  // flag for a dispatched frame not yet all on screen
+  bool frame_in_flight{false};
+  // flag for recolouring the frame in the current colour scheme
+  bool recolour{false};
 
-  // method: dispatch render tasks to queue
+  // method: start the pool of render threads
+  void startRenderThreads();
+  // method: have each group of render threads first touch the pages of its
+  // band of rows of a freshly allocated buffer
+  void placeRows(void *data, size_t row_bytes);
+  // method: dispatch render tasks to the render threads
   void dispatchRender(std::vector<Uint32> &pixels);
+  // method: dispatch the next progressive pass, if the frame has one left
+  bool dispatchNextPass();
+  // method: dispatch the next step of equalising a finished frame: the
+  // histogram pass (unless its passes counted it), then the merge, then
+  // the colour pass
+  void dispatchEqualisation();
+  // method: size the per-thread histograms for the current limit, zeroed
+  void resetWorkerHistograms();
+  // method: palette for the current scheme, limit and colouring
+  std::shared_ptr<std::vector<Uint32> const> framePalette() const;
+  // method: split regions into tiles and queue them for the render threads
+  void submitTiles(std::shared_ptr<RenderOptions const> const &options,
+                   std::vector<Tile> const &regions);
   // method: reset bounds of drawing
   void setBoundsFromState();
+  // method: move the center by an offset on the complex plane
+  void moveCenter(double dx, double dy);
+  // method: distance of one pan step, a whole number of pixels
+  double panDistance(unsigned int screen_size, double range) const;
+  // method: snapshot of the current view, for comparing with the last frame
+  FrameState currentFrameState() const;
+  // method: regions of the buffer that must be recomputed for the new view,
+  // after moving or rescaling whatever of the old frame can be reused; sets
+  // resume_from if the old frame's orbits can carry on to a higher limit
+  std::vector<Tile> reuseFrame(std::vector<Uint32> &pixels,
+                               bool previous_complete,
+                               unsigned int &resume_from);
+  // method: anchor a new pixel lattice at the current center and zoom
+  void resetLattice();
+  // method: fill the tiles of the regions found in the cache, returning
+  // the regions that are left to compute
+  std::vector<Tile> useCache(RenderOptions &options,
+                             std::vector<Tile> const &regions);
+  // method: with tracing on, record the frame just finished and print a
+  // summary of it
+  void traceFrame();
+  // method: build the reference orbit for a deep-zoom frame
+  std::shared_ptr<DeepView const> prepareDeepView();
+  // method: colour the frame's iteration counts in the current scheme
+  void recolourFrame(std::vector<Uint32> &pixels);
   // method: purge render queue and set flag to recalculate pixels
   void setDirty();
 };
@@ -0,0 +1,418 @@
+#include "perturbation.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <complex>
+
+std::shared_ptr<ReferenceOrbit>
+computeReferenceOrbit(BigFloat const &cx, BigFloat const &cy,
+                      unsigned int max_iterations,
+                      unsigned int fraction_limbs) {
+  auto orbit = std::make_shared<ReferenceOrbit>();
+  orbit->cx = cx.withPrecision(fraction_limbs);
+  orbit->cy = cy.withPrecision(fraction_limbs);
+
+  BigFloat zr(0.0, fraction_limbs);
+  BigFloat zi(0.0, fraction_limbs);
+
+  orbit->zr.push_back(0.0);
+  orbit->zi.push_back(0.0);
+
+  for (unsigned int n = 0; n < max_iterations; n++) {
+    BigFloat zr2 = zr * zr;
+    BigFloat zi2 = zi * zi;
+    BigFloat zri = zr * zi;
+
+    zr = zr2 - zi2 + orbit->cx;
+    zi = zri + zri + orbit->cy;
+
+    double r = zr.toDouble();
+    double i = zi.toDouble();
+    orbit->zr.push_back(r);
+    orbit->zi.push_back(i);
+
+    // The escaping value is kept, since pixels compare against Z_{n+1}
+    if (r * r + i * i >= 4.0) {
+      break;
+    }
+  }
+
+  return orbit;
+}
+
+void computeSeriesApproximation(ReferenceOrbit &orbit, double half_x,
+                                double half_y, double pixel_spacing,
+                                unsigned int max_iterations) {
+  using complex = std::complex<double>;
+
+  // Pixels near the boundary magnify any error in the deltas they start
+  // from, so what the series leaves out has to stay below the rounding of
+  // the delta itself: the first dropped term, d*dc^4, within DBL_EPSILON of
+  // a*dc, and the probes within a millionth of a pixel (scaled by |A|)
+  constexpr double tolerance = 1e-6;
+  constexpr double dropped = DBL_EPSILON;
+
+  // Largest share of the b*dc^2 term the c*dc^3 term may grow to, so that
+  // the terms past d*dc^4 shrink at least as fast
+  constexpr double truncation = 1e-5;
+
+  // The probes only sample the view, so the skip stops this many iterations
+  // (or a quarter of them, if more) short of the last one that passed
+  constexpr unsigned int margin = 16;
+  constexpr unsigned int margin_fraction = 4;
+
+  // Corners, edge midpoints and a ring halfway in, as deltas from the
+  // reference point, which needn't be the view center
+  complex probes[12] = {{-half_x, -half_y},         {half_x, -half_y},
+                        {-half_x, half_y},          {half_x, half_y},
+                        {0.0, -half_y},             {0.0, half_y},
+                        {-half_x, 0.0},             {half_x, 0.0},
+                        {-half_x / 2, -half_y / 2}, {half_x / 2, -half_y / 2},
+                        {-half_x / 2, half_y / 2},  {half_x / 2, half_y / 2}};
+  double radius = 0.0;
+  for (complex &probe : probes) {
+    probe -= complex{orbit.offset_x, orbit.offset_y};
+    radius = std::max(radius, std::abs(probe));
+  }
+  complex exact[12] = {};
+
+  // dz = a*dc + b*dc^2 + c*dc^3, advanced by dz' = 2*Z*dz + dz^2 + dc
+  complex a{0.0}, b{0.0}, c{0.0}, d{0.0};
+  auto advance = [&](unsigned int n) {
+    complex z{orbit.zr[n], orbit.zi[n]};
+    d = 2.0 * z * d + 2.0 * a * c + b * b;
+    complex next_c = 2.0 * z * c + 2.0 * a * b;
+    complex next_b = 2.0 * z * b + a * a;
+    complex next_a = 2.0 * z * a + 1.0;
+    a = next_a;
+    b = next_b;
+    c = next_c;
+  };
+
+  unsigned int passed = 0;
+
+  for (unsigned int n = 0;
+       n + 1 < orbit.zr.size() && n + 1 < max_iterations; n++) {
+    complex z{orbit.zr[n], orbit.zi[n]};
+    complex next{orbit.zr[n + 1], orbit.zi[n + 1]};
+    advance(n);
+
+    if (!std::isfinite(std::abs(c)) ||
+        std::abs(c) * radius > truncation * std::abs(b)) {
+      break;
+    }
+
+    double r2 = radius * radius;
+    if (!std::isfinite(std::abs(d)) ||
+        std::abs(d) * r2 * r2 > dropped * std::abs(a) * radius) {
+      break;
+    }
+
+    double allowed = tolerance * std::abs(a) * pixel_spacing;
+    bool fits = true;
+
+    for (unsigned int p = 0; p < 12 && fits; p++) {
+      complex dc = probes[p];
+      exact[p] = 2.0 * z * exact[p] + exact[p] * exact[p] + dc;
+
+      complex series = a * dc + b * dc * dc + c * dc * dc * dc;
+
+      // Once any probe escapes, the skipped iterations would hide escapes
+      fits = std::abs(series - exact[p]) <= allowed &&
+             std::norm(next + exact[p]) < 4.0;
+    }
+    if (!fits) {
+      break;
+    }
+    passed = n + 1;
+  }
+
+  unsigned int back_off = std::max(margin, passed / margin_fraction);
+  orbit.skipped = passed > back_off ? passed - back_off : 0;
+
+  a = b = c = d = 0.0;
+  for (unsigned int n = 0; n < orbit.skipped; n++) {
+    advance(n);
+  }
+  orbit.a_r = a.real();
+  orbit.a_i = a.imag();
+  orbit.b_r = b.real();
+  orbit.b_i = b.imag();
+  orbit.c_r = c.real();
+  orbit.c_i = c.imag();
+}
+
+/** Fills in the parts of a PerturbationRow that come from the orbit */
+PerturbationRow rowForOrbit(ReferenceOrbit const &orbit,
+                            unsigned int max_iterations) {
+  PerturbationRow row;
+  row.reference_r = &orbit.zr[0];
+  row.reference_i = &orbit.zi[0];
+  row.reference_length = orbit.zr.size();
+  row.skipped = orbit.skipped;
+  row.a_r = orbit.a_r;
+  row.a_i = orbit.a_i;
+  row.b_r = orbit.b_r;
+  row.b_i = orbit.b_i;
+  row.c_r = orbit.c_r;
+  row.c_i = orbit.c_i;
+  row.max_iterations = max_iterations;
+  return row;
+}
+
+/** The orbit of the point (x, y) from the view center */
+std::shared_ptr<ReferenceOrbit> orbitAt(DeepView const &view, double x,
+                                        double y,
+                                        unsigned int max_iterations) {
+  std::shared_ptr<ReferenceOrbit> orbit =
+      computeReferenceOrbit(view.center_x + BigFloat(x),
+                            view.center_y + BigFloat(y), max_iterations,
+                            view.fraction_limbs);
+  orbit->offset_x = x;
+  orbit->offset_y = y;
+  return orbit;
+}
+
+std::shared_ptr<ReferenceOrbit>
+choosePrimaryReference(DeepView &view, unsigned int max_iterations) {
+  std::shared_ptr<ReferenceOrbit> best = orbitAt(view, 0.0, 0.0,
+                                                 max_iterations);
+
+  // Probes sit in the middle of square cells of pixels
+  unsigned int width = std::lround(2.0 * view.half_x / view.dx);
+  unsigned int height = std::lround(2.0 * view.half_y / view.dy);
+  unsigned int cell =
+      std::max(1u, std::max(width, height) / REFERENCE_PROBES);
+  unsigned int columns = std::max(1u, width / cell);
+  unsigned int rows = std::max(1u, height / cell);
+  std::vector<unsigned int> counts(columns);
+
+  for (unsigned int search = 0;
+       search < MAX_REFERENCE_SEARCHES && best->zr.size() <= max_iterations;
+       search++) {
+    // Probes are only iterated as far as the reference goes; those that get
+    // there without escaping or glitching outlive it
+    unsigned int lasts = best->zr.size() - 1;
+    PerturbationRow row = rowForOrbit(*best, lasts);
+    row.dc_x0 = -view.half_x - best->offset_x;
+    row.dx = view.dx;
+    row.first = cell / 2;
+    row.stride = cell;
+    row.width = columns;
+
+    double nearest = INFINITY;
+    double pick_x = 0.0, pick_y = 0.0;
+    for (unsigned int l = 0; l < rows; l++) {
+      double y = -view.half_y + (cell / 2 + l * cell) * view.dy;
+      row.dc_y = y - best->offset_y;
+      view.kernel(row, &counts[0]);
+
+      for (unsigned int k = 0; k < columns; k++) {
+        double x = -view.half_x + (cell / 2 + k * cell) * view.dx;
+        if (counts[k] == lasts && std::hypot(x, y) < nearest) {
+          nearest = std::hypot(x, y);
+          pick_x = x;
+          pick_y = y;
+        }
+      }
+    }
+    if (nearest == INFINITY) {
+      break;
+    }
+
+    // Whichever orbit is passed over may still suit some pixels
+    std::shared_ptr<ReferenceOrbit> candidate =
+        orbitAt(view, pick_x, pick_y, max_iterations);
+    view.rebased_orbits++;
+    if (candidate->zr.size() <= best->zr.size()) {
+      view.shared.push_back(candidate);
+      break;
+    }
+    view.shared.push_back(best);
+    best = candidate;
+  }
+
+  return best;
+}
+
+bool iterateTileDeep(DeepView const &view, Tile const &tile,
+                     unsigned int max_iterations, unsigned int step,
+                     bool first_pass, unsigned int *iterations,
+                     std::function<bool()> const &cancelled) {
+  unsigned int width = tile.x1 - tile.x0;
+  unsigned int height = tile.y1 - tile.y0;
+
+  // Results come back as one contiguous run and are scattered into the tile
+  std::vector<unsigned int> samples((width + step - 1) / step);
+  auto scatter = [&](unsigned int j, SampleRun const &run, unsigned int k0,
+                     unsigned int count) {
+    for (unsigned int k = 0; k < count; k++) {
+      iterations[j * width + run.first + (k0 + k) * run.stride - tile.x0] =
+          samples[k];
+    }
+  };
+
+  // Iterates count samples of row j, from the k'th, around orbit
+  auto iterate = [&](ReferenceOrbit const &orbit, unsigned int j,
+                     SampleRun const &run, unsigned int k,
+                     unsigned int count) {
+    PerturbationRow row = rowForOrbit(orbit, max_iterations);
+    row.dc_x0 = -view.half_x - orbit.offset_x;
+    row.dx = view.dx;
+    row.dc_y = (-view.half_y + (tile.y0 + j) * view.dy) - orbit.offset_y;
+    row.first = run.first + k * run.stride;
+    row.stride = run.stride;
+    row.width = count;
+    view.kernel(row, &samples[0]);
+    scatter(j, run, k, count);
+  };
+
+  for (unsigned int j = 0; j < height; j++) {
+    SampleRun run = samplesInRow(tile.x0, tile.x1, tile.y0 + j, step,
+                                 first_pass);
+    if (run.count == 0) {
+      continue;
+    }
+    if (cancelled()) {
+      return false;
+    }
+    iterate(*view.reference, j, run, 0, run.count);
+  }
+
+  auto findGlitched = [&] {
+    std::vector<unsigned int> glitched;
+    for (unsigned int k = 0; k < width * height; k++) {
+      if (iterations[k] == GLITCHED_PIXEL) {
+        glitched.push_back(k);
+      }
+    }
+    return glitched;
+  };
+
+  // Calls iterate(j, run, k, count) for each stretch of glitched pixels
+  auto forGlitchedRuns = [&](auto iterate) {
+    for (unsigned int j = 0; j < height; j++) {
+      SampleRun run = samplesInRow(tile.x0, tile.x1, tile.y0 + j, step,
+                                   first_pass);
+      auto isGlitched = [&](unsigned int k) {
+        return iterations[j * width + run.first + k * run.stride - tile.x0] ==
+               GLITCHED_PIXEL;
+      };
+
+      unsigned int k = 0;
+      while (k < run.count) {
+        if (!isGlitched(k)) {
+          k++;
+          continue;
+        }
+
+        unsigned int run_end = k;
+        while (run_end < run.count && isGlitched(run_end)) {
+          run_end++;
+        }
+        iterate(j, run, k, run_end - k);
+        k = run_end;
+      }
+    }
+  };
+
+  // Pixels outside this pass's samples are never glitched, as the caller
+  // leaves them at zero. Glitched pixels go through the frame's shared
+  // references first; only then does the tile compute references of its
+  // own, which the tiles after it get to try too.
+  std::vector<unsigned int> glitched = findGlitched();
+  std::vector<ReferenceOrbit const *> own;
+  std::size_t tried = 0;
+  unsigned int rebases = 0;
+  while (!glitched.empty()) {
+    if (cancelled()) {
+      return false;
+    }
+
+    std::shared_ptr<ReferenceOrbit const> orbit;
+    {
+      std::lock_guard<std::mutex> guard(view.shared_lock);
+      while (!orbit && tried < view.shared.size()) {
+        orbit = view.shared[tried++];
+        if (std::find(own.begin(), own.end(), orbit.get()) != own.end()) {
+          orbit.reset();
+        }
+      }
+    }
+
+    bool shared = orbit != nullptr;
+    if (!shared) {
+      if (rebases == MAX_REBASES) {
+        break;
+      }
+      rebases++;
+
+      // A glitched pixel from the middle of the bunch becomes the new
+      // reference; it can't glitch against itself, so every rebase should
+      // fix at least one pixel
+      unsigned int pick = glitched[glitched.size() / 2];
+      orbit = orbitAt(view, -view.half_x + (tile.x0 + pick % width) * view.dx,
+                      -view.half_y + (tile.y0 + pick / width) * view.dy,
+                      max_iterations);
+      view.rebased_orbits++;
+
+      std::lock_guard<std::mutex> guard(view.shared_lock);
+      if (view.shared.size() < MAX_SHARED_REFERENCES) {
+        view.shared.push_back(orbit);
+        own.push_back(orbit.get());
+      }
+    }
+
+    // Only the runs of glitched pixels are iterated again
+    forGlitchedRuns([&](unsigned int j, SampleRun const &run, unsigned int k,
+                        unsigned int count) {
+      iterate(*orbit, j, run, k, count);
+    });
+
+    // A reference of the tile's own that fixes nothing ends the rebasing
+    std::size_t before = glitched.size();
+    glitched = findGlitched();
+    if (!shared && glitched.size() == before) {
+      break;
+    }
+  }
+
+  if (glitched.empty()) {
+    return true;
+  }
+  if (cancelled()) {
+    return false;
+  }
+
+  // What no reference could compute is iterated directly in double-double,
+  // each row placed from the view center at full precision
+  if (view.fallback) {
+    RowParams row = view.fallback_row;
+    row.max_iterations = max_iterations;
+    int last_row = -1;
+    forGlitchedRuns([&](unsigned int j, SampleRun const &run, unsigned int k,
+                        unsigned int count) {
+      if ((int)j != last_row) {
+        BigFloat y =
+            view.center_y + BigFloat(-view.half_y + (tile.y0 + j) * view.dy);
+        row.y = y.toDouble();
+        row.y_lo = (y - BigFloat(row.y)).toDouble();
+        last_row = j;
+      }
+      row.first = run.first + k * run.stride;
+      row.stride = run.stride;
+      row.width = count;
+      view.fallback(row, &samples[0]);
+      scatter(j, run, k, count);
+    });
+    view.fallback_pixels += glitched.size();
+    return true;
+  }
+
+  // Whatever is still glitched is drawn as interior
+  for (unsigned int k : glitched) {
+    iterations[k] = max_iterations;
+  }
+  view.unresolved_pixels += glitched.size();
+  return true;
+}
@@ -0,0 +1,123 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include "big_float.h"
+#include "kernels.h"
+#include "progressive.h"
+#include "tile_scheduler.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* Below this pixel spacing a double no longer resolves neighbouring values of
+ * c well enough, and views are rendered by perturbation instead */
+constexpr double DEEP_ZOOM_PIXEL_SPACING = DOUBLE_PIXEL_SPACING;
+
+/* Number of reference orbits a tile computes of its own for glitched pixels
+ * that the frame's shared references don't fix. What is still glitched after
+ * that is handed to double-double, or past its precision left unresolved. */
+constexpr unsigned int MAX_REBASES = 8;
+
+/* Most references a frame shares between its tiles */
+constexpr unsigned int MAX_SHARED_REFERENCES = 16;
+
+/* The primary reference is picked from a grid of this many probe pixels
+ * across the longer side of the view... */
+constexpr unsigned int REFERENCE_PROBES = 32;
+/* ...replacing it with a probe that outlives it at most this many times */
+constexpr unsigned int MAX_REFERENCE_SEARCHES = 16;
+
+/** The orbit Z_0 = 0, Z_{n+1} = Z_n^2 + C of one reference point C, computed
+ * at high precision and rounded to doubles, plus the series approximation
+ * coefficients for skipping its first `skipped` iterations.
+ */
+struct ReferenceOrbit {
+  BigFloat cx;
+  BigFloat cy;
+  /* Where C sits relative to the center of the view it serves */
+  double offset_x{0};
+  double offset_y{0};
+  std::vector<double> zr;
+  std::vector<double> zi;
+  unsigned int skipped{0};
+  double a_r{0}, a_i{0}, b_r{0}, b_i{0}, c_r{0}, c_i{0};
+};
+
+/** Everything a render thread needs to compute a deep-zoom tile.
+ * Pixel (i, j) sits at (center_x - half_x + i * dx) +
+ * (center_y - half_y + j * dy)i, and is iterated as a delta from the primary
+ * reference, or failing that from one of the shared ones.
+ */
+struct DeepView {
+  BigFloat center_x;
+  BigFloat center_y;
+  std::shared_ptr<ReferenceOrbit const> reference;
+  double dx;
+  double dy;
+  double half_x;
+  double half_y;
+  unsigned int fraction_limbs;
+  PerturbationKernel kernel;
+  /* Double-double kernel for pixels still glitched after the rebases, with
+     the row's corner, spacing and shortcuts set; null past its precision */
+  RowKernel fallback{nullptr};
+  RowParams fallback_row{};
+  /* Glitched pixels the fallback computed, and those nothing could, which
+     are drawn as interior */
+  mutable std::atomic<unsigned long> fallback_pixels{0};
+  mutable std::atomic<unsigned long> unresolved_pixels{0};
+  /* References glitched pixels try before a tile computes its own, which
+     join them while there is room, so that each is computed once a frame */
+  mutable std::mutex shared_lock;
+  mutable std::vector<std::shared_ptr<ReferenceOrbit const>> shared;
+  /* Reference orbits computed for the frame after the primary one */
+  mutable std::atomic<unsigned long> rebased_orbits{0};
+};
+
+/** Computes the orbit of (cx, cy) until it escapes or reaches max_iterations */
+std::shared_ptr<ReferenceOrbit>
+computeReferenceOrbit(BigFloat const &cx, BigFloat const &cy,
+                      unsigned int max_iterations,
+                      unsigned int fraction_limbs);
+
+/** Picks the primary reference of a view whose center, size, precision and
+ * kernel are set. The center's orbit is taken unless it escapes; then a grid
+ * of probe pixels is iterated around it, and the probe nearest the center of
+ * those that outlive it becomes the reference instead, up to
+ * MAX_REFERENCE_SEARCHES times. Orbits passed over become the view's first
+ * shared references.
+ */
+std::shared_ptr<ReferenceOrbit>
+choosePrimaryReference(DeepView &view, unsigned int max_iterations);
+
+/** Finds how many iterations the series approximation can skip for the
+ * pixels of a view (half_x by half_y either side of its center) around the
+ * orbit's reference point. Each step must keep the cubic term small against
+ * the quadratic one and the first term left out below the rounding of the
+ * linear one over the whole view, and stay within a millionth of a pixel
+ * (pixel_spacing) of exact perturbation at probes on the corners, edges and
+ * inside of the view. The skip then stops a margin short of the last step
+ * that passed, as the probes only sample the view.
+ */
+void computeSeriesApproximation(ReferenceOrbit &orbit, double half_x,
+                                double half_y, double pixel_spacing,
+                                unsigned int max_iterations);
+
+/** Computes iteration counts for the pixels of a tile that a progressive
+ * pass with the given step computes (row-major, tile width wide; other pixels
+ * are left alone). Glitched pixels are iterated again around the view's
+ * shared references, then around up to MAX_REBASES new ones taken from among
+ * them, and in double-double if that doesn't fix them. A step of 1 on the
+ * first pass computes every pixel.
+ *
+ * cancelled is polled between rows; once it returns true the tile is
+ * abandoned and false returned, with iterations only partly computed.
+ */
+bool iterateTileDeep(DeepView const &view, Tile const &tile,
+                     unsigned int max_iterations, unsigned int step,
+                     bool first_pass, unsigned int *iterations,
+                     std::function<bool()> const &cancelled);
+
+#endif
@@ -0,0 +1,156 @@
+#include "png_writer.h"
+#include <cstring>
+#include <iostream>
+
+/* Compressed bytes gathered into each IDAT chunk */
+constexpr size_t CHUNK_SIZE = 1 << 18;
+
+/* PNG filter type of each row: the difference from the byte above */
+constexpr unsigned char FILTER_UP = 2;
+
+namespace {
+
+void putBigEndian(unsigned char *dest, Uint32 value) {
+  dest[0] = value >> 24;
+  dest[1] = value >> 16;
+  dest[2] = value >> 8;
+  dest[3] = value;
+}
+
+} // namespace
+
+PngWriter::~PngWriter() {
+  if (stream_open) {
+    deflateEnd(&stream);
+  }
+}
+
+bool PngWriter::open(std::string const &path, unsigned int new_width,
+                     unsigned int new_height, int level) {
+  width = new_width;
+  height = new_height;
+
+  file.open(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Could not create " << path << std::endl;
+    return false;
+  }
+
+  if (deflateInit(&stream, level) != Z_OK) {
+    std::cerr << "Could not set up compression for " << path << std::endl;
+    return false;
+  }
+  stream_open = true;
+
+  static unsigned char const signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1a, '\n'};
+  file.write((char const *)signature, sizeof(signature));
+  bytes_written += sizeof(signature);
+
+  // 8 bits per channel, truecolour, no interlacing
+  unsigned char header[13];
+  putBigEndian(header, width);
+  putBigEndian(header + 4, height);
+  header[8] = 8;
+  header[9] = 2;
+  header[10] = 0;
+  header[11] = 0;
+  header[12] = 0;
+  writeChunk("IHDR", header, sizeof(header));
+
+  previous.assign(3 * (size_t)width, 0);
+  filtered.resize(1 + 3 * (size_t)width);
+  output.resize(CHUNK_SIZE);
+  stream.next_out = &output[0];
+  stream.avail_out = output.size();
+
+  return !failed;
+}
+
+bool PngWriter::writeRows(Uint32 const *pixels, unsigned int rows) {
+  for (unsigned int j = 0; j < rows && !failed; j++) {
+    Uint32 const *row = pixels + (size_t)width * j;
+
+    filtered[0] = FILTER_UP;
+    for (unsigned int i = 0; i < width; i++) {
+      unsigned char rgb[3] = {(unsigned char)(row[i] >> 16),
+                              (unsigned char)(row[i] >> 8),
+                              (unsigned char)row[i]};
+      for (unsigned int c = 0; c < 3; c++) {
+        filtered[1 + 3 * i + c] = rgb[c] - previous[3 * i + c];
+        previous[3 * i + c] = rgb[c];
+      }
+    }
+
+    compress(&filtered[0], filtered.size(), Z_NO_FLUSH);
+    rows_written++;
+  }
+
+  return !failed;
+}
+
+bool PngWriter::finish() {
+  if (rows_written != height) {
+    std::cerr << "PNG has " << rows_written << " of its " << height
+              << " rows" << std::endl;
+    failed = true;
+  }
+
+  if (!failed && compress(nullptr, 0, Z_FINISH)) {
+    writeChunk("IEND", nullptr, 0);
+  }
+  file.close();
+
+  return !failed && file;
+}
+
+bool PngWriter::compress(unsigned char const *data, size_t size, int flush) {
+  stream.next_in = (Bytef *)data;
+  stream.avail_in = size;
+
+  while (!failed) {
+    int result = deflate(&stream, flush);
+    if (result == Z_STREAM_ERROR) {
+      failed = true;
+      break;
+    }
+
+    // Each time the output buffer fills it goes out as one chunk
+    bool done = flush == Z_FINISH ? result == Z_STREAM_END
+                                  : stream.avail_in == 0;
+    if (stream.avail_out == 0 || (done && flush == Z_FINISH)) {
+      writeChunk("IDAT", &output[0], output.size() - stream.avail_out);
+      stream.next_out = &output[0];
+      stream.avail_out = output.size();
+    }
+    if (done) {
+      break;
+    }
+  }
+
+  return !failed;
+}
+
+void PngWriter::writeChunk(char const *type, unsigned char const *data,
+                           size_t size) {
+  unsigned char length[4];
+  putBigEndian(length, size);
+
+  // The checksum covers the type and the data, but not the length
+  uLong crc = crc32(0, (Bytef const *)type, 4);
+  if (size > 0) {
+    crc = crc32(crc, data, size);
+  }
+  unsigned char checksum[4];
+  putBigEndian(checksum, crc);
+
+  file.write((char const *)length, 4);
+  file.write(type, 4);
+  file.write((char const *)data, size);
+  file.write((char const *)checksum, 4);
+  bytes_written += 12 + size;
+
+  if (!file) {
+    failed = true;
+  }
+}
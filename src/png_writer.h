@@ -0,0 +1,62 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include "SDL.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+/**
+ * Writes a PNG a few rows at a time, so that an image far bigger than memory
+ * can be streamed out as it is rendered.
+ *
+ * Rows are filtered against the row above ("up" filtering, which turns the
+ * flat runs of a fractal into zeros), deflated as they arrive and written
+ * out in IDAT chunks whenever the output buffer fills, so only the buffer
+ * and the previous row are held on to.
+ */
+class PngWriter {
+public:
+  PngWriter() = default;
+  ~PngWriter();
+
+  PngWriter(PngWriter const &) = delete;
+  PngWriter &operator=(PngWriter const &) = delete;
+
+  // creates the file and writes the header of a width x height RGB image;
+  // returns false if the file couldn't be created
+  bool open(std::string const &path, unsigned int width, unsigned int height,
+            int level = Z_DEFAULT_COMPRESSION);
+  // appends rows of ARGB pixels (alpha is dropped), width pixels apart
+  bool writeRows(Uint32 const *pixels, unsigned int rows);
+  // writes out the end of the image; false if anything failed on the way
+  bool finish();
+
+  // bytes written to the file so far
+  unsigned long long bytesWritten() const { return bytes_written; }
+
+private:
+  std::ofstream file;
+  z_stream stream{};
+  bool stream_open{false};
+  bool failed{false};
+
+  unsigned int width{0};
+  unsigned int height{0};
+  unsigned int rows_written{0};
+  unsigned long long bytes_written{0};
+
+  // the previous row, as bytes, for filtering against
+  std::vector<unsigned char> previous;
+  // the row being filtered, behind its filter type byte
+  std::vector<unsigned char> filtered;
+  // compressed data not yet written out
+  std::vector<unsigned char> output;
+
+  // compresses size bytes, writing out each chunk's worth of output
+  bool compress(unsigned char const *data, size_t size, int flush);
+  void writeChunk(char const *type, unsigned char const *data, size_t size);
+};
+
+#endif
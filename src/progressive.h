@@ -0,0 +1,47 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+/**
+ * Progressive rendering computes a frame in passes: first every 8th pixel in
+ * each direction, each filling the 8x8 block it starts, then every 4th, 2nd
+ * and finally every pixel. Each pass only computes the pixels earlier passes
+ * didn't, and fills the block it is now responsible for.
+ */
+constexpr unsigned int PROGRESSIVE_FIRST_STEP = 8;
+
+/** The pixels first, first + stride, ... (count of them) of one row */
+struct SampleRun {
+  unsigned int first;
+  unsigned int stride;
+  unsigned int count;
+};
+
+/** The pixels of row j in [x0, x1) that the pass with the given step
+ * computes. In every pass but the first, the rows shared with the previous
+ * pass only need the pixels in between the ones it already computed.
+ * A step of 1 on the first pass is a plain full-resolution render.
+ */
+inline SampleRun samplesInRow(unsigned int x0, unsigned int x1, unsigned int j,
+                              unsigned int step, bool first_pass) {
+  SampleRun run{0, step, 0};
+
+  if (j % step != 0) {
+    return run;
+  }
+
+  // pixel indices offset + k * stride
+  unsigned int offset = 0;
+  if (!first_pass && j % (2 * step) == 0) {
+    offset = step;
+    run.stride = 2 * step;
+  }
+
+  // first index >= x0 with index % stride == offset
+  unsigned int base = x0 - x0 % run.stride + offset;
+  run.first = base >= x0 ? base : base + run.stride;
+  run.count = run.first < x1 ? (x1 - run.first + run.stride - 1) / run.stride
+                             : 0;
+  return run;
+}
+
+#endif
@@ -0,0 +1,362 @@
+#include "bounded_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Microbenchmark of the job queues handing work to render threads.
+ *
+ * Three queues are compared:
+ * - polling: the original MessageQueue, which waits 20 ms on every receive
+ *   and pops the newest job under a mutex;
+ * - mutex: a deque under a mutex with a condition variable, as each worker's
+ *   deque in the tile scheduler is;
+ * - lock-free: BoundedQueue, which the scheduler takes submitted jobs from.
+ *
+ * For each thread count, that many producers and that many consumers pass
+ * timestamped items through the queue, and the latency from push to pop and
+ * the throughput are measured. A polling consumer that misses a wakeup sleeps
+ * out its 20 ms with items waiting, so the polling queue gets fewer items.
+ * In the idle test consumers wait on an empty queue for a while, and the CPU
+ * time they burn doing so is measured.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+struct Item {
+  Clock::time_point pushed;
+};
+
+/** The job queue the viewer started out with */
+template <class T> class PollingQueue {
+public:
+  void push(T &&value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(value));
+    condition.notify_one();
+  }
+
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait_for(lock, std::chrono::milliseconds(20));
+    if (queue.empty()) {
+      return {};
+    }
+
+    T value = std::move(queue.back());
+    queue.pop_back();
+    return value;
+  }
+
+  void close() { running = false; }
+  bool open() const { return running; }
+
+private:
+  std::deque<T> queue;
+  std::condition_variable condition;
+  std::mutex mutex;
+  std::atomic<bool> running{true};
+};
+
+/** A deque under a mutex, blocking on a condition variable */
+template <class T> class MutexQueue {
+public:
+  void push(T &&value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(value));
+    }
+    condition.notify_one();
+  }
+
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !queue.empty() || closed; });
+    if (queue.empty()) {
+      return {};
+    }
+
+    T value = std::move(queue.front());
+    queue.pop_front();
+    return value;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    condition.notify_all();
+  }
+  bool open() const { return !closed; }
+
+private:
+  std::deque<T> queue;
+  std::condition_variable condition;
+  std::mutex mutex;
+  std::atomic<bool> closed{false};
+};
+
+/** BoundedQueue with a push that waits for room, like the others' */
+template <class T> class LockFreeQueue {
+public:
+  void push(T &&value) {
+    while (!queue.tryPush(std::move(value))) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::optional<T> pop() { return queue.pop(); }
+  void close() {
+    closed = true;
+    queue.close();
+  }
+  bool open() const { return !closed; }
+
+private:
+  BoundedQueue<T> queue{1024};
+  std::atomic<bool> closed{false};
+};
+
+struct LatencyResult {
+  std::string queue;
+  unsigned int threads;
+  double seconds;
+  unsigned long items;
+  double mean_latency_us;
+  double max_latency_us;
+};
+
+struct IdleResult {
+  std::string queue;
+  unsigned int threads;
+  double cpu_ms_per_second;
+};
+
+/** threads producers push items_per_producer items each through a fresh
+ * queue, while threads consumers pop them until it is closed and drained
+ */
+template <class Q>
+LatencyResult measureLatency(std::string const &name, unsigned int threads,
+                             unsigned long items_per_producer) {
+  Q queue;
+  std::vector<double> total_us(threads, 0.0);
+  std::vector<double> max_us(threads, 0.0);
+
+  std::vector<std::thread> consumers;
+  for (unsigned int c = 0; c < threads; c++) {
+    consumers.emplace_back([&, c] {
+      // The polling queue's pop comes back empty on a timeout too, so only
+      // an empty pop after the queue was seen closed means it is drained
+      while (true) {
+        bool open = queue.open();
+        std::optional<Item> item = queue.pop();
+        if (!item) {
+          if (!open) {
+            break;
+          }
+          continue;
+        }
+        double us = std::chrono::duration<double, std::micro>(Clock::now() -
+                                                              item->pushed)
+                        .count();
+        total_us[c] += us;
+        max_us[c] = std::max(max_us[c], us);
+      }
+    });
+  }
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> producers;
+  for (unsigned int p = 0; p < threads; p++) {
+    producers.emplace_back([&] {
+      for (unsigned long i = 0; i < items_per_producer; i++) {
+        queue.push(Item{Clock::now()});
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+
+  // Consumers drain what is left, then see the queue closed
+  queue.close();
+  for (auto &consumer : consumers) {
+    consumer.join();
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  LatencyResult result{name, threads, seconds, items_per_producer * threads,
+                       0.0, 0.0};
+  for (unsigned int c = 0; c < threads; c++) {
+    result.mean_latency_us += total_us[c];
+    result.max_latency_us = std::max(result.max_latency_us, max_us[c]);
+  }
+  result.mean_latency_us /= result.items;
+  return result;
+}
+
+/** CPU time per second that threads consumers burn waiting on an empty
+ * queue
+ */
+template <class Q>
+IdleResult measureIdle(std::string const &name, unsigned int threads,
+                       double seconds) {
+  Q queue;
+  std::vector<std::thread> consumers;
+  for (unsigned int c = 0; c < threads; c++) {
+    consumers.emplace_back([&] {
+      while (queue.open()) {
+        queue.pop();
+      }
+    });
+  }
+
+  // Let the threads start and go to sleep before measuring
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::clock_t cpu_start = std::clock();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  double cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+  queue.close();
+  for (auto &consumer : consumers) {
+    consumer.join();
+  }
+
+  return IdleResult{name, threads, cpu_ms / seconds};
+}
+
+/** Parses a comma-separated list of positive integers such as "1,2,4" */
+std::vector<unsigned int> parseList(std::string const &text) {
+  std::vector<unsigned int> values;
+  std::stringstream stream(text);
+  std::string item;
+
+  while (std::getline(stream, item, ',')) {
+    unsigned long value = std::stoul(item);
+    if (value == 0) {
+      throw std::invalid_argument(item);
+    }
+    values.push_back(value);
+  }
+
+  return values;
+}
+
+void usage() {
+  std::cout << "Usage: QueueBench [options]" << std::endl
+            << "\t--threads <n,n,...>: producers (and as many consumers) "
+               "per run (default: 1,2,4,8,16,32,64)"
+            << std::endl
+            << "\t--items <n>: items pushed per run (default: 200000)"
+            << std::endl
+            << "\t--polling-items <n>: items pushed per run of the polling "
+               "queue (default: 1000)"
+            << std::endl
+            << "\t--idle-seconds <s>: how long to watch idle consumers "
+               "(default: 1)"
+            << std::endl
+            << "\t--output <path>: where to write the JSON results (default: "
+               "queue_bench.json)"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<unsigned int> thread_counts{1, 2, 4, 8, 16, 32, 64};
+  unsigned long items = 200000;
+  unsigned long polling_items = 1000;
+  double idle_seconds = 1.0;
+  std::string output_path = "queue_bench.json";
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--threads" && i + 1 < argc) {
+        thread_counts = parseList(argv[++i]);
+      } else if (arg == "--items" && i + 1 < argc) {
+        items = std::max(1ul, std::stoul(argv[++i]));
+      } else if (arg == "--polling-items" && i + 1 < argc) {
+        polling_items = std::max(1ul, std::stoul(argv[++i]));
+      } else if (arg == "--idle-seconds" && i + 1 < argc) {
+        idle_seconds = std::stod(argv[++i]);
+      } else if (arg == "--output" && i + 1 < argc) {
+        output_path = argv[++i];
+      } else {
+        usage();
+        return 1;
+      }
+    }
+  } catch (...) {
+    std::cout << "Error: Please provide numeric arguments." << std::endl;
+    return 1;
+  }
+
+  std::vector<LatencyResult> latencies;
+  std::vector<IdleResult> idles;
+
+  for (unsigned int threads : thread_counts) {
+    unsigned long per_producer = std::max(1ul, items / threads);
+    unsigned long per_polling_producer = std::max(1ul, polling_items / threads);
+    for (LatencyResult const &r :
+         {measureLatency<PollingQueue<Item>>("polling", threads,
+                                             per_polling_producer),
+          measureLatency<MutexQueue<Item>>("mutex", threads, per_producer),
+          measureLatency<LockFreeQueue<Item>>("lock-free", threads,
+                                              per_producer)}) {
+      latencies.push_back(r);
+      std::cout << r.queue << " x" << threads << ": "
+                << 1e9 * r.seconds / r.items << " ns per item, latency "
+                << r.mean_latency_us << " us mean, " << r.max_latency_us
+                << " us max" << std::endl;
+    }
+
+    for (IdleResult const &r :
+         {measureIdle<PollingQueue<Item>>("polling", threads, idle_seconds),
+          measureIdle<MutexQueue<Item>>("mutex", threads, idle_seconds),
+          measureIdle<LockFreeQueue<Item>>("lock-free", threads,
+                                           idle_seconds)}) {
+      idles.push_back(r);
+      std::cout << r.queue << " x" << threads << " idle: "
+                << r.cpu_ms_per_second << " ms CPU per second" << std::endl;
+    }
+  }
+
+  std::ofstream out(output_path);
+  out << "{" << std::endl << "  \"latency\": [" << std::endl;
+  for (size_t k = 0; k < latencies.size(); k++) {
+    LatencyResult const &r = latencies[k];
+    out << "    {\"queue\": \"" << r.queue << "\", \"threads\": " << r.threads
+        << ", \"items\": " << r.items
+        << ", \"ns_per_item\": " << 1e9 * r.seconds / r.items
+        << ", \"mean_latency_us\": " << r.mean_latency_us
+        << ", \"max_latency_us\": " << r.max_latency_us << "}"
+        << (k + 1 < latencies.size() ? "," : "") << std::endl;
+  }
+  out << "  ]," << std::endl << "  \"idle\": [" << std::endl;
+  for (size_t k = 0; k < idles.size(); k++) {
+    IdleResult const &r = idles[k];
+    out << "    {\"queue\": \"" << r.queue << "\", \"threads\": " << r.threads
+        << ", \"cpu_ms_per_second\": " << r.cpu_ms_per_second << "}"
+        << (k + 1 < idles.size() ? "," : "") << std::endl;
+  }
+  out << "  ]" << std::endl << "}" << std::endl;
+
+  if (!out) {
+    std::cerr << "Could not write " << output_path << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote out " << output_path << std::endl;
+  return 0;
+}
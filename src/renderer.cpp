@@ -1,5 +1,7 @@
 #include "renderer.h"
+#include "trace.h"
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -9,7 +11,8 @@
 const unsigned int SCREENSHOT_FRAMES = 6;
 
 Renderer::Renderer(unsigned int screen_width, unsigned int screen_height)
-    : screen_width(screen_width), screen_height(screen_height) {
+    : screen_width(screen_width), screen_height(screen_height),
+      dirty_rows(screen_width, screen_height) {
   // Initialize SDL
   if (SDL_Init(SDL_INIT_VIDEO) < 0) {
     std::cerr << "SDL could not initialize." << std::endl;
@@ -48,6 +51,7 @@ Renderer::Renderer(unsigned int screen_width, unsigned int screen_height)
   pixels = std::vector<Uint32>(screen_height * screen_width, 0);
 
   // initial render (to make screen black);
+  dirty_rows.markAll();
   render(SDL_Rect{0, 0, 0, 0});
 }
 
@@ -57,49 +61,54 @@ Renderer::~Renderer() {
   SDL_Quit();
 }
 
-/** Since older compilers don't have the <filesystem> header, this
- * function is for checking the existence of screenshot files
- */
-inline bool file_exists(const std::string &name) {
-  if (FILE *file = fopen(name.c_str(), "r")) {
-    fclose(file);
-    return true;
-  } else {
-    return false;
-  }
-}
-
 void Renderer::captureScreenshot() {
-  SDL_Surface *screenshot =
-      SDL_CreateRGBSurface(0, screen_width, screen_height, 32, 0x00ff0000,
-                           0x0000ff00, 0x000000ff, 0xff000000);
-
-  SDL_RenderReadPixels(sdl_renderer, NULL, SDL_PIXELFORMAT_ARGB8888,
-                       screenshot->pixels, screenshot->pitch);
-
-  // Figure out where the next free screenshot path is
-  unsigned int next_screenshot_slot = 0;
-  std::string output_path{"screenshot-" + std::to_string(next_screenshot_slot) +
-                          ".bmp"};
-
-  while (file_exists(output_path)) {
-    next_screenshot_slot++;
-    output_path = "screenshot-" + std::to_string(next_screenshot_slot) + ".bmp";
+  // Snapshot the frame buffer for the writer thread to compress and save
+  Screenshot screenshot;
+  screenshot.pixels = pixels;
+  screenshot.width = screen_width;
+  screenshot.height = screen_height;
+
+  if (!screenshot_writer.submit(std::move(screenshot))) {
+    std::cerr << "Screenshot dropped: still writing the previous ones"
+              << std::endl;
+    return;
   }
 
-  SDL_SaveBMP(screenshot, output_path.c_str());
-  SDL_FreeSurface(screenshot);
-
-  std::cout << "Wrote out " << output_path << std::endl;
-
   screenshot_state = SCREENSHOT_FRAMES;
 }
 
-void Renderer::render(SDL_Rect selection) {
+bool Renderer::changed(SDL_Rect selection) const {
+  return present_requested || screenshot_state > 0 ||
+         !SDL_RectEquals(&selection, &last_selection) || dirty_rows.any();
+}
 
-  // Apply pixels vector to texture
-  SDL_UpdateTexture(sdl_texture, NULL, &pixels[0],
-                    screen_width * sizeof(uint32_t));
+bool Renderer::render(SDL_Rect selection) {
+  std::vector<SDL_Rect> rects = dirty_rows.take();
+  if (rects.empty() && !changed(selection)) {
+    return false;
+  }
+
+  TraceSpan span("render");
+
+  // Copy the changed rows of the pixels vector into the texture
+  {
+    TraceSpan upload("texture upload");
+    for (SDL_Rect const &rect : rects) {
+      Uint32 const *source = &pixels[screen_width * rect.y + rect.x];
+      void *dest;
+      int pitch;
+      if (SDL_LockTexture(sdl_texture, &rect, &dest, &pitch) == 0) {
+        for (int j = 0; j < rect.h; j++) {
+          std::memcpy((char *)dest + j * pitch, source + screen_width * j,
+                      rect.w * sizeof(Uint32));
+        }
+        SDL_UnlockTexture(sdl_texture);
+      } else {
+        SDL_UpdateTexture(sdl_texture, &rect, source,
+                          screen_width * sizeof(Uint32));
+      }
+    }
+  }
 
   // Clear renderer
   SDL_RenderClear(sdl_renderer);
@@ -113,9 +122,12 @@ void Renderer::render(SDL_Rect selection) {
 
   SDL_SetRenderDrawColor(sdl_renderer, 200, 200, 200, 127);
   SDL_RenderDrawRect(sdl_renderer, &selection);
+  last_selection = selection;
+  present_requested = false;
 
   // Render screenshot box -- use sine to map remaining frames to a
-  // smooth curve from 0 to 1 to 0 again
+  // smooth curve from 0 to 1 to 0 again. The frame after the last one
+  // must be presented too, to take the box off again.
   if (screenshot_state > 0) {
     double alpha_value = 127 * std::sin((SCREENSHOT_FRAMES - screenshot_state) *
                                         (M_PI / SCREENSHOT_FRAMES));
@@ -123,18 +135,25 @@ void Renderer::render(SDL_Rect selection) {
     SDL_SetRenderDrawColor(sdl_renderer, 255, 255, 225, alpha_value);
     SDL_RenderFillRect(sdl_renderer, &r);
     screenshot_state -= 1;
+    present_requested = true;
   }
 
   // Render screen
+  TraceSpan present("present");
   SDL_RenderPresent(sdl_renderer);
+  return true;
 }
 
 void Renderer::updateWindowTitle(unsigned int iterations, double x_min,
-                                 double x_max, double y_min, double y_max) {
+                                 double x_max, double y_min, double y_max,
+                                 unsigned long unresolved) {
   std::string title{std::to_string(iterations) + " iterations -- top-left@(" +
                     std::to_string(x_min) + "," + std::to_string(y_min) +
                     ") -- bottom-right@(" + std::to_string(x_max) + "," +
                     std::to_string(y_max) + ")"};
+  if (unresolved > 0) {
+    title += " -- " + std::to_string(unresolved) + " glitched pixels";
+  }
 
   // Change window title to reflect current view
   SDL_SetWindowTitle(sdl_window, title.c_str());
@@ -2,6 +2,8 @@
 #define RENDERER_H
 
 #include "SDL.h"
+#include "dirty_rows.h"
+#include "screenshot_writer.h"
 #include <memory>
 #include <vector>
 
@@ -10,14 +12,27 @@ public:
   Renderer(unsigned int screen_width, unsigned int screen_height);
   ~Renderer();
 
+  // queue the frame buffer to be saved as the next free screenshot-<n>.png
   void captureScreenshot();
 
-  void render(SDL_Rect selection);
+  // uploads the marked rows and presents the frame with the selection box
+  // on top; does nothing (returning false) if none of it changed
+  bool render(SDL_Rect selection);
+  // true if render() has something new to show
+  bool changed(SDL_Rect selection) const;
+  // have the next render() present even if nothing changed, e.g. once the
+  // window has been uncovered
+  void requestPresent() { present_requested = true; }
+  // shows the view in the window title, with the number of pixels a deep
+  // zoom couldn't compute if there are any
   void updateWindowTitle(unsigned int iterations, double x_min, double x_max,
-                         double y_min, double y_max);
+                         double y_min, double y_max,
+                         unsigned long unresolved = 0);
 
   // get mutable access to pixel data
   std::vector<Uint32> &getPixels() { return pixels; };
+  // rows of the pixel data changed since the last render()
+  DirtyRows &getDirtyRows() { return dirty_rows; }
 
   unsigned int getScreenWidth() { return screen_width; }
   unsigned int getScreenHeight() { return screen_height; }
@@ -31,8 +46,14 @@ private:
 
   unsigned int screen_width;
   unsigned int screen_height;
+  DirtyRows dirty_rows;
 
-  int screenshot_state;
+  // selection box last presented
+  SDL_Rect last_selection{0, 0, 0, 0};
+  bool present_requested{true};
+
+  int screenshot_state{0};
+  ScreenshotWriter screenshot_writer;
 };
 
 #endif
\ No newline at end of file
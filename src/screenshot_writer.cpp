@@ -0,0 +1,63 @@
+#include "screenshot_writer.h"
+#include "png_writer.h"
+#include "trace.h"
+#include <cstdio>
+#include <iostream>
+
+/** Since older compilers don't have the <filesystem> header, this
+ * function is for checking the existence of screenshot files
+ */
+inline bool file_exists(const std::string &name) {
+  if (FILE *file = fopen(name.c_str(), "r")) {
+    fclose(file);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+ScreenshotWriter::ScreenshotWriter() {
+  thread = std::thread(&ScreenshotWriter::writerLoop, this);
+}
+
+ScreenshotWriter::~ScreenshotWriter() {
+  // The writer drains the queue before it sees it closed
+  queue.close();
+  thread.join();
+}
+
+bool ScreenshotWriter::submit(Screenshot &&screenshot) {
+  return queue.tryPush(std::move(screenshot));
+}
+
+void ScreenshotWriter::writerLoop() {
+  if (Trace::enabled()) {
+    Trace::setThreadName("screenshot writer");
+  }
+
+  while (std::optional<Screenshot> screenshot = queue.pop()) {
+    TraceSpan span("screenshot");
+    std::string path = nextPath();
+
+    PngWriter writer;
+    if (writer.open(path, screenshot->width, screenshot->height) &&
+        writer.writeRows(&screenshot->pixels[0], screenshot->height) &&
+        writer.finish()) {
+      std::cout << "Wrote out " << path << std::endl;
+    } else {
+      std::cerr << "Could not write " << path << std::endl;
+    }
+  }
+}
+
+std::string ScreenshotWriter::nextPath() {
+  // Only this thread names screenshots, so the slots before the last one
+  // taken needn't be probed again
+  std::string path;
+  do {
+    path = "screenshot-" + std::to_string(next_slot) + ".png";
+    next_slot++;
+  } while (file_exists(path));
+
+  return path;
+}
@@ -0,0 +1,49 @@
+#ifndef SCREENSHOT_WRITER_H
+#define SCREENSHOT_WRITER_H
+
+#include "SDL.h"
+#include "bounded_queue.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A copy of the frame buffer waiting to be written out */
+struct Screenshot {
+  std::vector<Uint32> pixels;
+  unsigned int width{0};
+  unsigned int height{0};
+};
+
+/**
+ * Writes screenshots out as PNGs on a thread of its own, so that taking one
+ * never waits on compression or the disk.
+ *
+ * Screenshots are queued in a small bounded queue; if the writer falls that
+ * far behind, further screenshots are dropped rather than held up. Whatever
+ * is queued is written out before the writer is destroyed.
+ */
+class ScreenshotWriter {
+public:
+  ScreenshotWriter();
+  ~ScreenshotWriter();
+
+  ScreenshotWriter(ScreenshotWriter const &) = delete;
+  ScreenshotWriter &operator=(ScreenshotWriter const &) = delete;
+
+  // queue a screenshot for writing; false if the queue is full
+  bool submit(Screenshot &&screenshot);
+
+private:
+  // screenshots that may wait for the writer at once
+  static constexpr size_t QUEUE_CAPACITY = 4;
+
+  BoundedQueue<Screenshot> queue{QUEUE_CAPACITY};
+  std::thread thread;
+  // where to start looking for a free screenshot-<n>.png path
+  unsigned int next_slot{0};
+
+  void writerLoop();
+  std::string nextPath();
+};
+
+#endif
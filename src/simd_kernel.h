@@ -0,0 +1,667 @@
+#ifndef SIMD_KERNEL_H
+#define SIMD_KERNEL_H
+
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+
+/** Row indices first + (i + lane) * stride of the pixels in one register.
+ * Integers up to 2^53 are exact in a double (2^24 in a float, more than any
+ * row has), so this is exact.
+ */
+template <class V>
+typename V::reg pixelIndex(unsigned int first, unsigned int stride,
+                           unsigned int i) {
+  return V::add(V::set1((double)first + (double)i * stride),
+                V::mul(V::ramp(), V::set1((double)stride)));
+}
+
+/** Raises (zr, zi) to the complex power POWER by squaring and multiplying,
+ * unrolled at compile time. z^2 is (zr^2 - zi^2) + (zr*zi + zr*zi)i, the same
+ * operations the Mandelbrot loop has always used.
+ */
+template <class V, unsigned int POWER>
+void complexPower(typename V::reg &zr, typename V::reg &zi) {
+  using reg = typename V::reg;
+
+  if constexpr (POWER % 2 == 0) {
+    reg zri = V::mul(zr, zi);
+    zr = V::sub(V::mul(zr, zr), V::mul(zi, zi));
+    zi = V::add(zri, zri);
+    if constexpr (POWER > 2) {
+      complexPower<V, POWER / 2>(zr, zi);
+    }
+  } else if constexpr (POWER > 1) {
+    reg base_r = zr, base_i = zi;
+    complexPower<V, POWER - 1>(zr, zi);
+    reg next_r = V::sub(V::mul(zr, base_r), V::mul(zi, base_i));
+    zi = V::add(V::mul(zr, base_i), V::mul(zi, base_r));
+    zr = next_r;
+  }
+}
+
+/** Generic escape-time loop, shared by the scalar and SSE2/AVX2/AVX-512
+ * kernels.
+ *
+ * V is a traits struct wrapping one instruction set's register of doubles or
+ * floats, V::scalar (see kernels*.cpp). Every translation unit that includes
+ * this header defines its traits in an anonymous namespace, so the
+ * instantiations never get merged across units compiled with different -m
+ * flags.
+ *
+ * The formula F and the power of z are template parameters, so each fractal
+ * family gets a loop of its own with the power fully unrolled and nothing
+ * decided per pixel; rowKernel() below picks the instantiation once.
+ *
+ * UNROLL independent register groups are iterated together to hide the
+ * latency of the multiply/add chain, so each pass covers
+ * V::lanes * UNROLL pixels. Lanes that escape are masked out of the
+ * iteration count and the group stops once every lane has escaped or been
+ * found to be inside the set. The last group of a row may run past the end
+ * of the row; those lanes are simply not stored.
+ */
+template <class V, Formula F = Formula::Mandelbrot, unsigned int POWER = 2,
+          unsigned int UNROLL = 2>
+void iterateRowVector(RowParams const &row, unsigned int *iterations) {
+  using reg = typename V::reg;
+  using mask = typename V::mask;
+  using scalar = typename V::scalar;
+
+  constexpr unsigned int group = V::lanes * UNROLL;
+
+  const reg four = V::set1(4.0);
+
+  // Orbits that come back within a thousandth of a pixel of an earlier
+  // point are taken to have converged to a cycle
+  const reg cycle_epsilon = V::set1(1e-6 * row.dx * row.dx);
+
+  for (unsigned int i = 0; i < row.width; i += group) {
+    reg cr[UNROLL], ci[UNROLL], zr[UNROLL], zi[UNROLL], count[UNROLL];
+    reg saved_zr[UNROLL], saved_zi[UNROLL];
+    mask active[UNROLL], interior[UNROLL];
+
+    // Values given per pixel are copied out for whole registers; the padding
+    // lanes of the last group repeat the last pixel
+    auto lanesOf = [&](double const *values, scalar *lanes) {
+      for (unsigned int l = 0; l < group; l++) {
+        lanes[l] = values[std::min(i + l, row.width - 1)];
+      }
+    };
+
+    // Registers of floats get the points the double kernels compute,
+    // rounded, so that a pixel's c doesn't depend on where its run starts.
+    // The lanes are zeroed as only some of the branches below fill them.
+    constexpr bool narrow = sizeof(scalar) < sizeof(double);
+    scalar lane_x[group]{}, lane_y[group]{};
+    if (row.xs) {
+      lanesOf(row.xs, lane_x);
+    } else if constexpr (narrow) {
+      for (unsigned int l = 0; l < group; l++) {
+        double index = (double)row.first + (double)(i + l) * row.stride;
+        lane_x[l] = row.x0 + index * row.dx;
+      }
+    }
+    if (row.ys) {
+      lanesOf(row.ys, lane_y);
+    }
+
+    bool resume = row.orbit_r && row.start_iteration > 0;
+    scalar start_r[group], start_i[group];
+    if (resume) {
+      lanesOf(row.orbit_r, start_r);
+      lanesOf(row.orbit_i, start_i);
+    }
+
+    for (unsigned int u = 0; u < UNROLL; u++) {
+      // x0 + (first + (i + lane) * stride) * dx, computed the same way for
+      // every kernel
+      reg index = pixelIndex<V>(row.first, row.stride, i + u * V::lanes);
+      reg pr = row.xs || narrow
+                   ? V::load(&lane_x[u * V::lanes])
+                   : V::add(V::set1(row.x0), V::mul(index, V::set1(row.dx)));
+      reg pi = row.ys ? V::load(&lane_y[u * V::lanes]) : V::set1(row.y);
+
+      // A Julia set's pixels are where z starts; everything else starts
+      // from 0 with c at the pixel
+      if constexpr (F == Formula::Julia) {
+        cr[u] = V::set1(row.c_r);
+        ci[u] = V::set1(row.c_i);
+        zr[u] = resume ? V::load(&start_r[u * V::lanes]) : pr;
+        zi[u] = resume ? V::load(&start_i[u * V::lanes]) : pi;
+      } else {
+        cr[u] = pr;
+        ci[u] = pi;
+        zr[u] = resume ? V::load(&start_r[u * V::lanes]) : V::set1(0.0);
+        zi[u] = resume ? V::load(&start_i[u * V::lanes]) : V::set1(0.0);
+      }
+      saved_zr[u] = zr[u];
+      saved_zi[u] = zi[u];
+      count[u] = V::set1((double)row.start_iteration);
+      interior[u] = V::none();
+
+      // The cardioid and bulb are the Mandelbrot set's own
+      constexpr bool has_cardioid = F == Formula::Mandelbrot && POWER == 2;
+      if (has_cardioid && row.cardioid_check) {
+        reg ci2 = V::mul(ci[u], ci[u]);
+        // Main cardioid: q(q + (x - 1/4)) <= y^2 / 4,
+        // where q = (x - 1/4)^2 + y^2
+        reg xq = V::sub(cr[u], V::set1(0.25));
+        reg q = V::add(V::mul(xq, xq), ci2);
+        mask in_cardioid = V::lessEqual(V::mul(q, V::add(q, xq)),
+                                        V::mul(ci2, V::set1(0.25)));
+        // Period-2 bulb: (x + 1)^2 + y^2 <= 1/16
+        reg xb = V::add(cr[u], V::set1(1.0));
+        mask in_bulb =
+            V::lessEqual(V::add(V::mul(xb, xb), ci2), V::set1(1.0 / 16.0));
+        interior[u] = V::orMask(in_cardioid, in_bulb);
+      }
+
+      active[u] = V::andNot(V::all(), interior[u]);
+    }
+
+    unsigned int next_save = 1;
+
+    for (unsigned int n = row.start_iteration; n < row.max_iterations; n++) {
+      bool any_active = false;
+
+      for (unsigned int u = 0; u < UNROLL; u++) {
+        if constexpr (F == Formula::BurningShip && POWER == 2) {
+          // Squares don't care about signs, so only the cross term needs
+          // folding: |zr|*|zi| is exactly |zr*zi|
+          reg zri = V::abs(V::mul(zr[u], zi[u]));
+          zr[u] = V::sub(V::mul(zr[u], zr[u]), V::mul(zi[u], zi[u]));
+          zi[u] = V::add(zri, zri);
+        } else {
+          if constexpr (F == Formula::BurningShip) {
+            zr[u] = V::abs(zr[u]);
+            zi[u] = V::abs(zi[u]);
+          }
+          complexPower<V, POWER>(zr[u], zi[u]);
+        }
+
+        zr[u] = V::add(zr[u], cr[u]);
+        zi[u] = V::add(zi[u], ci[u]);
+
+        // squared-magnitude bailout: |z|^2 >= 4 instead of |z| >= 2
+        reg magnitude = V::add(V::mul(zr[u], zr[u]), V::mul(zi[u], zi[u]));
+        active[u] = V::andNot(active[u], V::greaterEqual(magnitude, four));
+        count[u] = V::increment(count[u], active[u]);
+
+        if (row.periodicity_check) {
+          reg dr = V::sub(zr[u], saved_zr[u]);
+          reg di = V::sub(zi[u], saved_zi[u]);
+          mask cycled = V::andMask(
+              active[u], V::lessEqual(V::add(V::mul(dr, dr), V::mul(di, di)),
+                                      cycle_epsilon));
+          interior[u] = V::orMask(interior[u], cycled);
+          active[u] = V::andNot(active[u], cycled);
+        }
+
+        any_active |= V::any(active[u]);
+      }
+
+      if (!any_active) {
+        break;
+      }
+
+      // Brent: remember the orbit at power-of-two steps, so any cycle is
+      // found once the gap between saves exceeds its period
+      if (row.periodicity_check && n + 1 - row.start_iteration == next_save) {
+        for (unsigned int u = 0; u < UNROLL; u++) {
+          saved_zr[u] = zr[u];
+          saved_zi[u] = zi[u];
+        }
+        next_save *= 2;
+      }
+    }
+
+    for (unsigned int u = 0; u < UNROLL; u++) {
+      scalar lanes[V::lanes], lanes_zr[V::lanes], lanes_zi[V::lanes];
+      V::store(lanes, count[u]);
+      V::store(lanes_zr, zr[u]);
+      V::store(lanes_zi, zi[u]);
+      unsigned int inside = V::bits(interior[u]);
+
+      for (unsigned int l = 0; l < V::lanes; l++) {
+        unsigned int index = i + u * V::lanes + l;
+        if (index >= row.width) {
+          continue;
+        }
+
+        bool is_inside = (inside >> l) & 1;
+        iterations[index] =
+            is_inside ? row.max_iterations : (unsigned int)lanes[l];
+
+        if (row.orbit_r && iterations[index] == row.max_iterations) {
+          row.orbit_r[index] = is_inside ? NAN : lanes_zr[l];
+          row.orbit_i[index] = is_inside ? NAN : lanes_zi[l];
+        }
+      }
+    }
+  }
+}
+
+/** A register of double-doubles: each lane holds the unevaluated sum
+ * hi + lo, with |lo| no more than half a unit in the last place of hi.
+ *
+ * The arithmetic is the classic error-free one (Dekker, Knuth): the rounding
+ * error of every sum and product of doubles is recovered exactly with plain
+ * adds and multiplies, splitting factors in halves of 26 bits rather than
+ * using FMA, so that every instruction set computes the same bits. It relies
+ * on the compiler neither contracting nor reassociating, which the kernels'
+ * -ffp-contract=off guarantees.
+ */
+template <class V> struct DoubleDouble {
+  typename V::reg hi;
+  typename V::reg lo;
+};
+
+/** a + b exactly, for any a and b */
+template <class V>
+DoubleDouble<V> twoSum(typename V::reg a, typename V::reg b) {
+  typename V::reg s = V::add(a, b);
+  typename V::reg b_part = V::sub(s, a);
+  typename V::reg a_part = V::sub(s, b_part);
+  return {s, V::add(V::sub(a, a_part), V::sub(b, b_part))};
+}
+
+/** a + b exactly, for |a| >= |b| */
+template <class V>
+DoubleDouble<V> quickTwoSum(typename V::reg a, typename V::reg b) {
+  typename V::reg s = V::add(a, b);
+  return {s, V::sub(b, V::sub(s, a))};
+}
+
+/** a * b exactly */
+template <class V>
+DoubleDouble<V> twoProduct(typename V::reg a, typename V::reg b) {
+  using reg = typename V::reg;
+
+  // Splits x into 26-bit halves, whose products are all exact
+  auto split = [](reg x, reg &high, reg &low) {
+    reg t = V::mul(V::set1(134217729.0), x); // 2^27 + 1
+    high = V::sub(t, V::sub(t, x));
+    low = V::sub(x, high);
+  };
+
+  reg p = V::mul(a, b);
+  reg a_high, a_low, b_high, b_low;
+  split(a, a_high, a_low);
+  split(b, b_high, b_low);
+  reg error = V::add(
+      V::add(V::add(V::sub(V::mul(a_high, b_high), p), V::mul(a_high, b_low)),
+             V::mul(a_low, b_high)),
+      V::mul(a_low, b_low));
+  return {p, error};
+}
+
+template <class V>
+DoubleDouble<V> ddAdd(DoubleDouble<V> const &a, DoubleDouble<V> const &b) {
+  // Both halves are summed exactly, so that cancelling high parts (as in
+  // zr^2 - zi^2) leave the low parts intact
+  DoubleDouble<V> high = twoSum<V>(a.hi, b.hi);
+  DoubleDouble<V> low = twoSum<V>(a.lo, b.lo);
+  high = quickTwoSum<V>(high.hi, V::add(high.lo, low.hi));
+  return quickTwoSum<V>(high.hi, V::add(high.lo, low.lo));
+}
+
+template <class V>
+DoubleDouble<V> ddSub(DoubleDouble<V> const &a, DoubleDouble<V> const &b) {
+  typename V::reg zero = V::set1(0.0);
+  return ddAdd<V>(a, {V::sub(zero, b.hi), V::sub(zero, b.lo)});
+}
+
+template <class V>
+DoubleDouble<V> ddMul(DoubleDouble<V> const &a, DoubleDouble<V> const &b) {
+  DoubleDouble<V> p = twoProduct<V>(a.hi, b.hi);
+  return quickTwoSum<V>(
+      p.hi, V::add(p.lo, V::add(V::mul(a.hi, b.lo), V::mul(a.lo, b.hi))));
+}
+
+/** a times a power of two, which is exact */
+template <class V>
+DoubleDouble<V> ddScale(DoubleDouble<V> const &a, double factor) {
+  return {V::mul(a.hi, V::set1(factor)), V::mul(a.lo, V::set1(factor))};
+}
+
+/** |a|: the low part takes the sign of the high part along */
+template <class V> DoubleDouble<V> ddAbs(DoubleDouble<V> const &a) {
+  return {V::abs(a.hi),
+          V::negateWhere(a.lo, V::lessEqual(a.hi, V::set1(0.0)))};
+}
+
+/** complexPower for double-doubles */
+template <class V, unsigned int POWER>
+void complexPower(DoubleDouble<V> &zr, DoubleDouble<V> &zi) {
+  if constexpr (POWER % 2 == 0) {
+    DoubleDouble<V> zri = ddMul<V>(zr, zi);
+    zr = ddSub<V>(ddMul<V>(zr, zr), ddMul<V>(zi, zi));
+    zi = ddScale<V>(zri, 2.0);
+    if constexpr (POWER > 2) {
+      complexPower<V, POWER / 2>(zr, zi);
+    }
+  } else if constexpr (POWER > 1) {
+    DoubleDouble<V> base_r = zr, base_i = zi;
+    complexPower<V, POWER - 1>(zr, zi);
+    DoubleDouble<V> next_r =
+        ddSub<V>(ddMul<V>(zr, base_r), ddMul<V>(zi, base_i));
+    zi = ddAdd<V>(ddMul<V>(zr, base_i), ddMul<V>(zi, base_r));
+    zr = next_r;
+  }
+}
+
+/** The escape-time loop of iterateRowVector in double-double arithmetic, for
+ * views too deep for a double to tell their pixels apart. V must be a traits
+ * struct of doubles.
+ *
+ * Pixels sit at (x0 + x0_lo) + index * dx: the offset from the row's first
+ * pixel needs no more than a double, and is added to x0 exactly. The escape
+ * test and cycle detection only need the high parts. Register groups aren't
+ * unrolled, since each double-double operation is a long enough chain of
+ * independent instructions already. Orbits are kept to double precision
+ * only.
+ */
+template <class V, Formula F = Formula::Mandelbrot, unsigned int POWER = 2>
+void iterateRowDoubleDouble(RowParams const &row, unsigned int *iterations) {
+  using reg = typename V::reg;
+  using mask = typename V::mask;
+  using dd = DoubleDouble<V>;
+
+  const reg zero = V::set1(0.0);
+  const reg four = V::set1(4.0);
+  const reg cycle_epsilon = V::set1(1e-6 * row.dx * row.dx);
+
+  for (unsigned int i = 0; i < row.width; i += V::lanes) {
+    auto lanesOf = [&](double const *values, double *lanes) {
+      for (unsigned int l = 0; l < V::lanes; l++) {
+        lanes[l] = values[std::min(i + l, row.width - 1)];
+      }
+    };
+
+    double lane_x[V::lanes], lane_y[V::lanes];
+    dd pr, pi;
+    if (row.xs) {
+      lanesOf(row.xs, lane_x);
+      pr = {V::load(lane_x), zero};
+    } else {
+      reg index = pixelIndex<V>(row.first, row.stride, i);
+      pr = twoSum<V>(V::set1(row.x0), V::mul(index, V::set1(row.dx)));
+      pr = quickTwoSum<V>(pr.hi, V::add(pr.lo, V::set1(row.x0_lo)));
+    }
+    if (row.ys) {
+      lanesOf(row.ys, lane_y);
+      pi = {V::load(lane_y), zero};
+    } else {
+      pi = quickTwoSum<V>(V::set1(row.y), V::set1(row.y_lo));
+    }
+
+    dd cr, ci, zr, zi;
+    if constexpr (F == Formula::Julia) {
+      cr = {V::set1(row.c_r), zero};
+      ci = {V::set1(row.c_i), zero};
+      zr = pr;
+      zi = pi;
+    } else {
+      cr = pr;
+      ci = pi;
+      zr = {zero, zero};
+      zi = {zero, zero};
+    }
+
+    bool resume = row.orbit_r && row.start_iteration > 0;
+    if (resume) {
+      double start_r[V::lanes], start_i[V::lanes];
+      lanesOf(row.orbit_r, start_r);
+      lanesOf(row.orbit_i, start_i);
+      zr = {V::load(start_r), zero};
+      zi = {V::load(start_i), zero};
+    }
+
+    dd saved_zr = zr, saved_zi = zi;
+    reg count = V::set1((double)row.start_iteration);
+    mask interior = V::none();
+
+    constexpr bool has_cardioid = F == Formula::Mandelbrot && POWER == 2;
+    if (has_cardioid && row.cardioid_check) {
+      // The tests of iterateRowVector, with each comparison made by the sign
+      // of a difference, which is the sign of its high part
+      dd ci2 = ddMul<V>(ci, ci);
+      dd xq = ddAdd<V>(cr, dd{V::set1(-0.25), zero});
+      dd q = ddAdd<V>(ddMul<V>(xq, xq), ci2);
+      dd cardioid =
+          ddSub<V>(ddMul<V>(q, ddAdd<V>(q, xq)), ddScale<V>(ci2, 0.25));
+      dd xb = ddAdd<V>(cr, dd{V::set1(1.0), zero});
+      dd bulb = ddAdd<V>(ddAdd<V>(ddMul<V>(xb, xb), ci2),
+                         dd{V::set1(-1.0 / 16.0), zero});
+      interior = V::orMask(V::lessEqual(cardioid.hi, zero),
+                           V::lessEqual(bulb.hi, zero));
+    }
+
+    mask active = V::andNot(V::all(), interior);
+    unsigned int next_save = 1;
+
+    for (unsigned int n = row.start_iteration; n < row.max_iterations; n++) {
+      if constexpr (F == Formula::BurningShip && POWER == 2) {
+        dd zri = ddAbs<V>(ddMul<V>(zr, zi));
+        zr = ddSub<V>(ddMul<V>(zr, zr), ddMul<V>(zi, zi));
+        zi = ddScale<V>(zri, 2.0);
+      } else {
+        if constexpr (F == Formula::BurningShip) {
+          zr = ddAbs<V>(zr);
+          zi = ddAbs<V>(zi);
+        }
+        complexPower<V, POWER>(zr, zi);
+      }
+
+      zr = ddAdd<V>(zr, cr);
+      zi = ddAdd<V>(zi, ci);
+
+      reg magnitude = V::add(V::mul(zr.hi, zr.hi), V::mul(zi.hi, zi.hi));
+      active = V::andNot(active, V::greaterEqual(magnitude, four));
+      count = V::increment(count, active);
+
+      if (row.periodicity_check) {
+        reg dr = ddSub<V>(zr, saved_zr).hi;
+        reg di = ddSub<V>(zi, saved_zi).hi;
+        mask cycled = V::andMask(
+            active, V::lessEqual(V::add(V::mul(dr, dr), V::mul(di, di)),
+                                 cycle_epsilon));
+        interior = V::orMask(interior, cycled);
+        active = V::andNot(active, cycled);
+      }
+
+      if (!V::any(active)) {
+        break;
+      }
+
+      if (row.periodicity_check && n + 1 - row.start_iteration == next_save) {
+        saved_zr = zr;
+        saved_zi = zi;
+        next_save *= 2;
+      }
+    }
+
+    double lanes[V::lanes], lanes_zr[V::lanes], lanes_zi[V::lanes];
+    V::store(lanes, count);
+    V::store(lanes_zr, zr.hi);
+    V::store(lanes_zi, zi.hi);
+    unsigned int inside = V::bits(interior);
+
+    for (unsigned int l = 0; l < V::lanes && i + l < row.width; l++) {
+      bool is_inside = (inside >> l) & 1;
+      iterations[i + l] =
+          is_inside ? row.max_iterations : (unsigned int)lanes[l];
+
+      if (row.orbit_r && iterations[i + l] == row.max_iterations) {
+        row.orbit_r[i + l] = is_inside ? NAN : lanes_zr[l];
+        row.orbit_i[i + l] = is_inside ? NAN : lanes_zi[l];
+      }
+    }
+  }
+}
+
+/** The instantiation of iterateRowVector (or iterateRowDoubleDouble) for a
+ * formula and power, which must be between MIN_POWER and MAX_POWER (others
+ * get MAX_POWER)
+ */
+template <class V, Formula F, bool DOUBLE_DOUBLE,
+          unsigned int POWER = MIN_POWER>
+RowKernel rowKernelForPower(unsigned int power) {
+  if constexpr (POWER < MAX_POWER) {
+    if (power != POWER) {
+      return rowKernelForPower<V, F, DOUBLE_DOUBLE, POWER + 1>(power);
+    }
+  }
+  if constexpr (DOUBLE_DOUBLE) {
+    return &iterateRowDoubleDouble<V, F, POWER>;
+  } else {
+    return &iterateRowVector<V, F, POWER>;
+  }
+}
+
+template <class V, bool DOUBLE_DOUBLE = false>
+RowKernel rowKernelForFormula(Formula formula, unsigned int power) {
+  switch (formula) {
+  case Formula::Julia:
+    return rowKernelForPower<V, Formula::Julia, DOUBLE_DOUBLE>(power);
+  case Formula::BurningShip:
+    return rowKernelForPower<V, Formula::BurningShip, DOUBLE_DOUBLE>(power);
+  default:
+    return rowKernelForPower<V, Formula::Mandelbrot, DOUBLE_DOUBLE>(power);
+  }
+}
+
+/** The row kernel for a formula, power and precision, given one instruction
+ * set's traits for registers of floats (VF) and of doubles (VD)
+ */
+template <class VF, class VD>
+RowKernel rowKernel(Formula formula, unsigned int power, Precision precision) {
+  switch (precision) {
+  case Precision::Float:
+    return rowKernelForFormula<VF>(formula, power);
+  case Precision::DoubleDouble:
+    return rowKernelForFormula<VD, true>(formula, power);
+  default:
+    return rowKernelForFormula<VD>(formula, power);
+  }
+}
+
+/** Generic perturbation loop, shared like iterateRowVector.
+ *
+ * Every lane of a group uses the same reference iteration, so Z_n is just
+ * broadcast. Each step computes dz' = (2*Z + dz)*dz + dc and tests the full
+ * value Z' + dz' for escape. Lanes where |Z' + dz'| has collapsed to a tiny
+ * fraction of |Z'| lose all their significant bits (Pauldelbrot's glitch
+ * criterion) and are handed back as GLITCHED_PIXEL, as are lanes still
+ * running when the reference orbit ends.
+ */
+template <class V, unsigned int UNROLL = 2>
+void iteratePerturbedRowVector(PerturbationRow const &row,
+                               unsigned int *iterations) {
+  using reg = typename V::reg;
+  using mask = typename V::mask;
+
+  constexpr unsigned int group = V::lanes * UNROLL;
+
+  const reg four = V::set1(4.0);
+  const reg dci = V::set1(row.dc_y);
+
+  for (unsigned int i = 0; i < row.width; i += group) {
+    reg dcr[UNROLL], dzr[UNROLL], dzi[UNROLL], count[UNROLL];
+    mask active[UNROLL], glitched[UNROLL];
+
+    for (unsigned int u = 0; u < UNROLL; u++) {
+      reg index = pixelIndex<V>(row.first, row.stride, i + u * V::lanes);
+      dcr[u] = V::add(V::set1(row.dc_x0), V::mul(index, V::set1(row.dx)));
+
+      // Series approximation: dz = a*dc + b*dc^2 + c*dc^3
+      reg dc2r = V::sub(V::mul(dcr[u], dcr[u]), V::mul(dci, dci));
+      reg dc2i = V::mul(V::set1(2.0), V::mul(dcr[u], dci));
+      reg dc3r = V::sub(V::mul(dc2r, dcr[u]), V::mul(dc2i, dci));
+      reg dc3i = V::add(V::mul(dc2r, dci), V::mul(dc2i, dcr[u]));
+
+      dzr[u] = V::add(
+          V::add(V::sub(V::mul(V::set1(row.a_r), dcr[u]),
+                        V::mul(V::set1(row.a_i), dci)),
+                 V::sub(V::mul(V::set1(row.b_r), dc2r),
+                        V::mul(V::set1(row.b_i), dc2i))),
+          V::sub(V::mul(V::set1(row.c_r), dc3r),
+                 V::mul(V::set1(row.c_i), dc3i)));
+      dzi[u] = V::add(
+          V::add(V::add(V::mul(V::set1(row.a_r), dci),
+                        V::mul(V::set1(row.a_i), dcr[u])),
+                 V::add(V::mul(V::set1(row.b_r), dc2i),
+                        V::mul(V::set1(row.b_i), dc2r))),
+          V::add(V::mul(V::set1(row.c_r), dc3i),
+                 V::mul(V::set1(row.c_i), dc3r)));
+
+      count[u] = V::set1((double)row.skipped);
+      active[u] = V::all();
+      glitched[u] = V::none();
+    }
+
+    for (unsigned int n = row.skipped; n < row.max_iterations; n++) {
+      if (n + 1 >= row.reference_length) {
+        for (unsigned int u = 0; u < UNROLL; u++) {
+          glitched[u] = V::orMask(glitched[u], active[u]);
+        }
+        break;
+      }
+
+      const reg twice_zr = V::set1(2.0 * row.reference_r[n]);
+      const reg twice_zi = V::set1(2.0 * row.reference_i[n]);
+      const double next_r = row.reference_r[n + 1];
+      const double next_i = row.reference_i[n + 1];
+      const reg glitch_tolerance =
+          V::set1(1e-6 * (next_r * next_r + next_i * next_i));
+
+      bool any_active = false;
+
+      for (unsigned int u = 0; u < UNROLL; u++) {
+        // 2*Z*dz + dz^2 = (2*Z + dz) * dz
+        reg tr = V::add(twice_zr, dzr[u]);
+        reg ti = V::add(twice_zi, dzi[u]);
+        reg next_dzr =
+            V::add(V::sub(V::mul(tr, dzr[u]), V::mul(ti, dzi[u])), dcr[u]);
+        reg next_dzi =
+            V::add(V::add(V::mul(tr, dzi[u]), V::mul(ti, dzr[u])), dci);
+        dzr[u] = next_dzr;
+        dzi[u] = next_dzi;
+
+        reg xr = V::add(V::set1(next_r), dzr[u]);
+        reg xi = V::add(V::set1(next_i), dzi[u]);
+        reg magnitude = V::add(V::mul(xr, xr), V::mul(xi, xi));
+
+        active[u] = V::andNot(active[u], V::greaterEqual(magnitude, four));
+
+        mask glitch =
+            V::andMask(active[u], V::lessEqual(magnitude, glitch_tolerance));
+        glitched[u] = V::orMask(glitched[u], glitch);
+        active[u] = V::andNot(active[u], glitch);
+
+        count[u] = V::increment(count[u], active[u]);
+        any_active |= V::any(active[u]);
+      }
+
+      if (!any_active) {
+        break;
+      }
+    }
+
+    for (unsigned int u = 0; u < UNROLL; u++) {
+      double lanes[V::lanes];
+      V::store(lanes, count[u]);
+      unsigned int bad = V::bits(glitched[u]);
+
+      for (unsigned int l = 0; l < V::lanes; l++) {
+        unsigned int index = i + u * V::lanes + l;
+        if (index < row.width) {
+          iterations[index] =
+              ((bad >> l) & 1) ? GLITCHED_PIXEL : (unsigned int)lanes[l];
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "tile_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+bool TileKey::operator==(TileKey const &other) const {
+  return zoom == other.zoom && x_range == other.x_range &&
+         y_range == other.y_range && screen_width == other.screen_width &&
+         screen_height == other.screen_height && anchor_x == other.anchor_x &&
+         anchor_y == other.anchor_y && tile_x == other.tile_x &&
+         tile_y == other.tile_y && tile_size == other.tile_size &&
+         max_iterations == other.max_iterations && fractal == other.fractal &&
+         cardioid_check == other.cardioid_check &&
+         periodicity_check == other.periodicity_check;
+}
+
+size_t TileKeyHash::operator()(TileKey const &key) const {
+  size_t seed = 0;
+  auto combine = [&seed](size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+  };
+
+  combine(std::hash<double>()(key.zoom));
+  combine(std::hash<double>()(key.x_range));
+  combine(std::hash<double>()(key.y_range));
+  combine(key.screen_width);
+  combine(key.screen_height);
+  combine(std::hash<double>()(key.anchor_x));
+  combine(std::hash<double>()(key.anchor_y));
+  combine(std::hash<long long>()(key.tile_x));
+  combine(std::hash<long long>()(key.tile_y));
+  combine(key.tile_size);
+  combine(key.max_iterations);
+  combine((unsigned int)key.fractal.formula | key.fractal.power << 2);
+  combine(key.cardioid_check | key.periodicity_check << 1);
+  return seed;
+}
+
+size_t TileCache::entrySize(TileKey const &key) {
+  return sizeof(Entry) + key.tile_size * key.tile_size * sizeof(unsigned int);
+}
+
+bool TileCache::lookup(TileKey const &key, unsigned int *dest,
+                       unsigned int stride) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto found = index.find(key);
+  if (found == index.end()) {
+    misses++;
+    return false;
+  }
+
+  hits++;
+  entries.splice(entries.begin(), entries, found->second);
+
+  std::vector<unsigned int> const &counts = found->second->second;
+  for (unsigned int j = 0; j < key.tile_size; j++) {
+    std::memcpy(dest + j * stride, &counts[j * key.tile_size],
+                key.tile_size * sizeof(unsigned int));
+  }
+  return true;
+}
+
+void TileCache::insert(TileKey const &key, unsigned int const *src,
+                       unsigned int stride) {
+  if (entrySize(key) > budget) {
+    return;
+  }
+
+  std::vector<unsigned int> counts(key.tile_size * key.tile_size);
+  for (unsigned int j = 0; j < key.tile_size; j++) {
+    std::memcpy(&counts[j * key.tile_size], src + j * stride,
+                key.tile_size * sizeof(unsigned int));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto found = index.find(key);
+  if (found != index.end()) {
+    found->second->second = std::move(counts);
+    entries.splice(entries.begin(), entries, found->second);
+    return;
+  }
+
+  entries.emplace_front(key, std::move(counts));
+  index[key] = entries.begin();
+  bytes += entrySize(key);
+
+  while (bytes > budget) {
+    bytes -= entrySize(entries.back().first);
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+}
+
+TileCacheStats TileCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  TileCacheStats result;
+  result.hits = hits;
+  result.misses = misses;
+  result.entries = entries.size();
+  result.bytes = bytes;
+  return result;
+}
@@ -0,0 +1,84 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include "fractal.h"
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/** Identifies one square tile of iteration counts.
+ *
+ * Views with the same pixel spacing whose centers lie a whole number of
+ * pixels from a common anchor share a lattice of pixels; a tile is a
+ * tile_size x tile_size square of that lattice, tile_x and tile_y tiles from
+ * the anchor. Everything else that changes the counts is part of the key too.
+ */
+struct TileKey {
+  /* Lattice: quantized zoom level, unzoomed view size and anchor */
+  double zoom;
+  double x_range;
+  double y_range;
+  unsigned int screen_width;
+  unsigned int screen_height;
+  double anchor_x;
+  double anchor_y;
+  /* Position on the lattice, in tiles */
+  long long tile_x;
+  long long tile_y;
+  unsigned int tile_size;
+  /* Parameters the counts depend on */
+  unsigned int max_iterations;
+  Fractal fractal;
+  bool cardioid_check;
+  bool periodicity_check;
+
+  bool operator==(TileKey const &other) const;
+};
+
+struct TileKeyHash {
+  size_t operator()(TileKey const &key) const;
+};
+
+/** Lookups since the cache was created, and what it holds now */
+struct TileCacheStats {
+  unsigned long hits{0};
+  unsigned long misses{0};
+  unsigned long entries{0};
+  size_t bytes{0};
+};
+
+/**
+ * An in-memory cache of tiles of iteration counts, evicting the least
+ * recently used tiles once it holds more than its memory budget. Safe to use
+ * from several threads at once.
+ */
+class TileCache {
+public:
+  explicit TileCache(size_t budget_bytes) : budget(budget_bytes) {}
+
+  // copies the tile's counts into dest (rows stride apart) if it is cached
+  bool lookup(TileKey const &key, unsigned int *dest, unsigned int stride);
+  // stores the tile's counts from src (rows stride apart)
+  void insert(TileKey const &key, unsigned int const *src,
+              unsigned int stride);
+
+  TileCacheStats stats() const;
+
+private:
+  using Entry = std::pair<TileKey, std::vector<unsigned int>>;
+
+  size_t budget;
+  size_t bytes{0};
+  // most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> index;
+  unsigned long hits{0};
+  unsigned long misses{0};
+  mutable std::mutex mutex;
+
+  static size_t entrySize(TileKey const &key);
+};
+
+#endif
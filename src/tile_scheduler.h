@@ -0,0 +1,369 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include "bounded_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/** A rectangle of pixels [x0, x1) x [y0, y1) */
+struct Tile {
+  unsigned int x0;
+  unsigned int y0;
+  unsigned int x1;
+  unsigned int y1;
+};
+
+/** How much work one worker thread did since the last resetStats() */
+struct WorkerStats {
+  double busy_seconds{0.0};
+  unsigned long jobs{0};
+  unsigned long steals{0};
+};
+
+/**
+ * A work-stealing pool of worker threads.
+ *
+ * Submitted jobs go into a shared lock-free queue, which workers take from
+ * in submission order (if a frame ever outgrows it, the rest are dealt
+ * round-robin across the workers' own deques instead). Every worker also
+ * owns a deque for jobs it pushes itself; it takes jobs from the back of its
+ * own deque first, then from the shared queue, and once both are empty it
+ * steals from the front of the others' deques. Idle workers sleep on a
+ * condition variable until more work arrives.
+ *
+ * Workers can be split into groups (such as the threads of one NUMA node),
+ * each with a shared queue of its own. Workers take from their own group's
+ * queue and steal from their own group's deques before turning to the
+ * others', so jobs stay with their group unless it runs out of work.
+ */
+template <class T> class TileScheduler {
+public:
+  using Handler = std::function<void(T &job, unsigned int worker)>;
+
+  // worker_groups gives each worker's group (all in group 0 if empty), and
+  // on_start is called on each worker thread before it takes any jobs
+  TileScheduler(unsigned int worker_count, Handler handler,
+                std::vector<unsigned int> worker_groups = {},
+                std::function<void(unsigned int worker)> on_start = nullptr);
+  ~TileScheduler();
+
+  // queue jobs, spread across all workers; each job goes to the group
+  // group_of gives it, if set, and otherwise to group 0
+  void submit(std::vector<T> &&jobs,
+              std::function<unsigned int(T const &)> const &group_of = {});
+  // queue a job on the given worker's own deque (e.g. from inside a job)
+  void push(unsigned int worker, T &&job);
+  // drop all queued jobs (jobs already running are left to finish);
+  // returns how many were dropped
+  unsigned int clear();
+  // block until no jobs are queued or running
+  void wait();
+  // true if no jobs are queued or running
+  bool idle() const { return pending == 0; }
+  // call callback (on whichever thread finished the last job) each time the
+  // workers run out of jobs, but not when clear() empties the queues. It is
+  // called with the scheduler's lock held, so it mustn't call back into the
+  // scheduler; once onIdle() returns, the previous callback won't be called
+  void onIdle(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    idle_callback = std::move(callback);
+  }
+
+  unsigned int workerCount() const { return workers.size(); }
+  std::vector<WorkerStats> stats() const;
+  void resetStats();
+
+private:
+  struct Worker {
+    unsigned int group{0};
+    std::mutex mutex;
+    std::deque<T> jobs;
+    std::atomic<long long> busy_nanoseconds{0};
+    std::atomic<unsigned long> jobs_done{0};
+    std::atomic<unsigned long> steals{0};
+  };
+
+  // submitted jobs beyond this many go onto the workers' deques
+  static constexpr size_t SHARED_CAPACITY = 1 << 14;
+
+  std::optional<T> take(unsigned int index);
+  // the oldest job of the next worker (in or out of index's group) with any
+  std::optional<T> steal(unsigned int index, bool same_group);
+  void workerLoop(unsigned int index);
+  // count jobs as done; the idle callback only runs for jobs that ran
+  void finished(unsigned int count, bool ran);
+
+  Handler handler;
+  std::function<void(unsigned int)> start_callback;
+  std::function<void()> idle_callback;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  // one shared queue per group
+  std::vector<std::unique_ptr<BoundedQueue<T>>> shared;
+
+  // jobs sitting in deques
+  std::atomic<unsigned int> queued{0};
+  // jobs sitting in deques or running
+  std::atomic<unsigned int> pending{0};
+  // round-robin position for submit()
+  unsigned int next_worker{0};
+
+  std::mutex idle_mutex;
+  std::condition_variable work_available;
+  std::condition_variable all_done;
+  bool running{true};
+};
+
+template <typename T>
+TileScheduler<T>::TileScheduler(
+    unsigned int worker_count, Handler handler,
+    std::vector<unsigned int> worker_groups,
+    std::function<void(unsigned int worker)> on_start)
+    : handler(std::move(handler)), start_callback(std::move(on_start)) {
+  if (worker_count == 0) {
+    worker_count = 1;
+  }
+
+  unsigned int group_count = 1;
+  for (unsigned int i = 0; i < worker_count; i++) {
+    workers.emplace_back(std::make_unique<Worker>());
+    if (i < worker_groups.size()) {
+      workers[i]->group = worker_groups[i];
+      group_count = std::max(group_count, worker_groups[i] + 1);
+    }
+  }
+
+  for (unsigned int g = 0; g < group_count; g++) {
+    shared.emplace_back(std::make_unique<BoundedQueue<T>>(SHARED_CAPACITY));
+  }
+
+  for (unsigned int i = 0; i < worker_count; i++) {
+    threads.emplace_back(&TileScheduler<T>::workerLoop, this, i);
+  }
+}
+
+template <typename T> TileScheduler<T>::~TileScheduler() {
+  clear();
+
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    running = false;
+  }
+  work_available.notify_all();
+
+  // Wait for all workers to exit (they might be mid-job)
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+template <typename T>
+void TileScheduler<T>::submit(
+    std::vector<T> &&jobs,
+    std::function<unsigned int(T const &)> const &group_of) {
+  pending += jobs.size();
+  queued += jobs.size();
+
+  for (auto &job : jobs) {
+    unsigned int group = group_of ? group_of(job) % shared.size() : 0;
+    if (shared[group]->tryPush(std::move(job))) {
+      continue;
+    }
+
+    Worker &worker = *workers[next_worker];
+    next_worker = (next_worker + 1) % workers.size();
+
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+  }
+
+  {
+    // Taking the lock means no worker can miss the wake-up between checking
+    // for work and going to sleep
+    std::lock_guard<std::mutex> lock(idle_mutex);
+  }
+  work_available.notify_all();
+}
+
+template <typename T> void TileScheduler<T>::push(unsigned int index, T &&job) {
+  pending++;
+  queued++;
+
+  {
+    Worker &worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+  }
+  work_available.notify_one();
+}
+
+template <typename T> unsigned int TileScheduler<T>::clear() {
+  unsigned int dropped = 0;
+
+  for (auto &queue : shared) {
+    while (queue->tryPop()) {
+      dropped++;
+    }
+  }
+
+  for (auto &worker : workers) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    dropped += worker->jobs.size();
+    worker->jobs.clear();
+  }
+
+  queued -= dropped;
+  finished(dropped, false);
+  return dropped;
+}
+
+template <typename T> void TileScheduler<T>::wait() {
+  std::unique_lock<std::mutex> lock(idle_mutex);
+  all_done.wait(lock, [this] { return pending == 0; });
+}
+
+template <typename T>
+std::vector<WorkerStats> TileScheduler<T>::stats() const {
+  std::vector<WorkerStats> result;
+
+  for (auto &worker : workers) {
+    WorkerStats s;
+    s.busy_seconds = worker->busy_nanoseconds / 1e9;
+    s.jobs = worker->jobs_done;
+    s.steals = worker->steals;
+    result.push_back(s);
+  }
+
+  return result;
+}
+
+template <typename T> void TileScheduler<T>::resetStats() {
+  for (auto &worker : workers) {
+    worker->busy_nanoseconds = 0;
+    worker->jobs_done = 0;
+    worker->steals = 0;
+  }
+}
+
+template <typename T>
+std::optional<T> TileScheduler<T>::take(unsigned int index) {
+  // Newest job from our own deque first...
+  {
+    Worker &own = *workers[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      T job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      queued--;
+      return job;
+    }
+  }
+
+  // ...then the oldest job submitted to our group...
+  unsigned int group = workers[index]->group;
+  if (std::optional<T> job = shared[group]->tryPop()) {
+    queued--;
+    return job;
+  }
+
+  // ...then the oldest job of the next worker in our group that has any...
+  if (std::optional<T> job = steal(index, true)) {
+    return job;
+  }
+
+  // ...and only once our group is out of work, the other groups' jobs
+  for (unsigned int offset = 1; offset < shared.size(); offset++) {
+    if (std::optional<T> job =
+            shared[(group + offset) % shared.size()]->tryPop()) {
+      queued--;
+      workers[index]->steals++;
+      return job;
+    }
+  }
+
+  return steal(index, false);
+}
+
+template <typename T>
+std::optional<T> TileScheduler<T>::steal(unsigned int index,
+                                         bool same_group) {
+  unsigned int group = workers[index]->group;
+
+  for (unsigned int offset = 1; offset < workers.size(); offset++) {
+    Worker &victim = *workers[(index + offset) % workers.size()];
+    if ((victim.group == group) != same_group) {
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      T job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      queued--;
+      workers[index]->steals++;
+      return job;
+    }
+  }
+
+  return {};
+}
+
+template <typename T> void TileScheduler<T>::workerLoop(unsigned int index) {
+  Worker &worker = *workers[index];
+
+  if (start_callback) {
+    start_callback(index);
+  }
+
+  while (true) {
+    std::optional<T> job = take(index);
+
+    if (!job) {
+      std::unique_lock<std::mutex> lock(idle_mutex);
+      work_available.wait(lock, [this] { return !running || queued > 0; });
+      if (!running) {
+        return;
+      }
+      continue;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    handler(*job, index);
+    auto end = std::chrono::steady_clock::now();
+
+    worker.busy_nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count();
+    worker.jobs_done++;
+
+    finished(1, true);
+  }
+}
+
+template <typename T>
+void TileScheduler<T>::finished(unsigned int count, bool ran) {
+  if (count > 0 && (pending -= count) == 0) {
+    // The callback is read and called under the lock that onIdle() takes to
+    // replace it, so a worker never calls one that is being swapped out
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    all_done.notify_all();
+    if (ran && idle_callback) {
+      idle_callback();
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,362 @@
+#include "topology.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/* First line of a sysfs file, or empty if it can't be read */
+std::string readLine(std::string const &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+unsigned int readNumber(std::string const &path, unsigned int fallback) {
+  try {
+    return std::stoul(readLine(path));
+  } catch (std::exception const &) {
+    return fallback;
+  }
+}
+
+/* CPUs the process's affinity mask allows, or all of them if unknown */
+std::set<unsigned int> allowedCpus() {
+  std::set<unsigned int> allowed;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        allowed.insert(cpu);
+      }
+    }
+  }
+#endif
+  return allowed;
+}
+
+} // namespace
+
+std::vector<unsigned int> parseCpuList(std::string const &text) {
+  std::vector<unsigned int> cpus;
+  std::istringstream list(text);
+  std::string range;
+
+  while (std::getline(list, range, ',')) {
+    size_t dash = range.find('-');
+    std::string first_text = range.substr(0, dash);
+    std::string last_text =
+        dash == std::string::npos ? first_text : range.substr(dash + 1);
+
+    size_t first_used = 0, last_used = 0;
+    unsigned int first = std::stoul(first_text, &first_used);
+    unsigned int last = std::stoul(last_text, &last_used);
+    if (first_used != first_text.size() || last_used != last_text.size() ||
+        last < first) {
+      throw std::invalid_argument(text);
+    }
+    for (unsigned int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return cpus;
+}
+
+std::string formatCpuList(std::vector<unsigned int> cpus) {
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+  std::ostringstream list;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+      j++;
+    }
+    list << (i > 0 ? "," : "") << cpus[i];
+    if (j > i) {
+      list << "-" << cpus[j];
+    }
+    i = j + 1;
+  }
+  return list.str();
+}
+
+CpuTopology readTopology(std::string const &root) {
+  std::vector<unsigned int> online;
+  try {
+    online = parseCpuList(readLine(root + "/cpu/online"));
+  } catch (std::invalid_argument const &) {
+  }
+  if (online.empty()) {
+    for (unsigned int cpu = 0;
+         cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+      online.push_back(cpu);
+    }
+  }
+
+  // Each CPU's node comes from the nodes' lists of their CPUs
+  std::map<unsigned int, unsigned int> node_of;
+  try {
+    for (unsigned int node : parseCpuList(readLine(root + "/node/online"))) {
+      std::string list = readLine(root + "/node/node" + std::to_string(node) +
+                                  "/cpulist");
+      for (unsigned int cpu : parseCpuList(list)) {
+        node_of[cpu] = node;
+      }
+    }
+  } catch (std::invalid_argument const &) {
+  }
+
+  std::set<unsigned int> allowed = allowedCpus();
+  CpuTopology topology;
+
+  for (unsigned int id : online) {
+    if (!allowed.empty() && allowed.count(id) == 0) {
+      continue;
+    }
+    std::string cpu = root + "/cpu/cpu" + std::to_string(id) + "/topology/";
+    Cpu entry;
+    entry.id = id;
+    entry.node = node_of.count(id) ? node_of[id] : 0;
+    entry.package = readNumber(cpu + "physical_package_id", 0);
+    // Without topology, each CPU counts as a core of its own
+    entry.core = readNumber(cpu + "core_id", id);
+    topology.cpus.push_back(entry);
+  }
+
+  return topology;
+}
+
+AffinitySpec parseAffinitySpec(std::string const &text) {
+  AffinitySpec spec;
+  std::istringstream items(text);
+  std::string item;
+
+  while (std::getline(items, item, ':')) {
+    if (item == "pin") {
+      spec.pin = true;
+    } else if (item.compare(0, 8, "reserve=") == 0) {
+      spec.reserve = std::stoul(item.substr(8));
+      spec.pin = true;
+    } else if (item.compare(0, 5, "cpus=") == 0) {
+      spec.cpus = parseCpuList(item.substr(5));
+      spec.pin = true;
+    } else {
+      size_t used = 0;
+      spec.threads = std::stoul(item, &used);
+      if (used != item.size() || spec.threads == 0) {
+        throw std::invalid_argument(text);
+      }
+    }
+  }
+
+  return spec;
+}
+
+ThreadPlacement ThreadPlacement::unpinned(unsigned int threads) {
+  ThreadPlacement placement;
+  placement.worker_cpus.assign(std::max(1u, threads), -1);
+  placement.worker_groups.assign(placement.worker_cpus.size(), 0);
+  placement.group_cpus.resize(1);
+  placement.group_nodes.push_back(0);
+  return placement;
+}
+
+ThreadPlacement planPlacement(CpuTopology const &topology,
+                              AffinitySpec const &spec) {
+  if (!spec.pin) {
+    return ThreadPlacement::unpinned(
+        spec.threads > 0 ? spec.threads : topology.cpus.size());
+  }
+
+  std::vector<Cpu> cpus;
+  for (unsigned int id : spec.cpus) {
+    auto found = std::find_if(topology.cpus.begin(), topology.cpus.end(),
+                              [id](Cpu const &cpu) { return cpu.id == id; });
+    if (found == topology.cpus.end()) {
+      throw std::invalid_argument("CPU " + std::to_string(id) +
+                                  " is offline or not allowed");
+    }
+    cpus.push_back(*found);
+  }
+  if (spec.cpus.empty()) {
+    cpus = topology.cpus;
+  }
+
+  // Number the CPUs of each core, so that every core's first CPU comes
+  // before any core's second
+  std::map<std::tuple<unsigned int, unsigned int>, unsigned int> siblings;
+  std::vector<std::tuple<unsigned int, unsigned int, Cpu>> ordered;
+  std::sort(cpus.begin(), cpus.end(),
+            [](Cpu const &a, Cpu const &b) { return a.id < b.id; });
+  for (Cpu const &cpu : cpus) {
+    unsigned int rank = siblings[std::make_tuple(cpu.package, cpu.core)]++;
+    ordered.emplace_back(cpu.node, rank, cpu);
+  }
+  std::stable_sort(ordered.begin(), ordered.end(),
+                   [](auto const &a, auto const &b) {
+                     return std::tie(std::get<0>(a), std::get<1>(a)) <
+                            std::tie(std::get<0>(b), std::get<1>(b));
+                   });
+
+  if (ordered.empty()) {
+    throw std::invalid_argument("no CPUs are available");
+  }
+
+  ThreadPlacement placement;
+
+  // Reserved cores, with all their CPUs, come from the first node
+  std::set<std::tuple<unsigned int, unsigned int>> reserved;
+  for (auto const &entry : ordered) {
+    Cpu const &cpu = std::get<2>(entry);
+    if (reserved.size() < spec.reserve &&
+        std::get<0>(entry) == std::get<0>(ordered.front())) {
+      reserved.insert(std::make_tuple(cpu.package, cpu.core));
+    }
+  }
+
+  std::map<unsigned int, std::vector<unsigned int>> node_cpus;
+  for (auto const &entry : ordered) {
+    Cpu const &cpu = std::get<2>(entry);
+    if (reserved.count(std::make_tuple(cpu.package, cpu.core))) {
+      placement.ui_cpus.push_back(cpu.id);
+    } else {
+      node_cpus[cpu.node].push_back(cpu.id);
+    }
+  }
+  if (node_cpus.empty()) {
+    throw std::invalid_argument("no CPUs are left for render threads");
+  }
+
+  std::vector<std::pair<unsigned int, std::vector<unsigned int>>> nodes(
+      node_cpus.begin(), node_cpus.end());
+  size_t available = 0;
+  for (auto const &node : nodes) {
+    available += node.second.size();
+  }
+  unsigned int threads = spec.threads > 0 ? spec.threads : available;
+
+  // Threads go round the nodes that have CPUs left, so that every node gets
+  // its share; past one thread per CPU they start round the CPUs again
+  std::map<unsigned int, unsigned int> group_of;
+  std::vector<size_t> next(nodes.size(), 0);
+  size_t used = 0;
+  size_t turn = 0;
+  for (unsigned int t = 0; t < threads; t++) {
+    if (used == available) {
+      std::fill(next.begin(), next.end(), 0);
+      used = 0;
+    }
+    while (next[turn % nodes.size()] ==
+           nodes[turn % nodes.size()].second.size()) {
+      turn++;
+    }
+    size_t index = turn++ % nodes.size();
+    auto const &node = nodes[index];
+    unsigned int cpu = node.second[next[index]++];
+    used++;
+
+    if (group_of.count(node.first) == 0) {
+      group_of[node.first] = placement.group_cpus.size();
+      placement.group_cpus.emplace_back();
+      placement.group_nodes.push_back(node.first);
+    }
+    unsigned int group = group_of[node.first];
+    placement.worker_cpus.push_back(cpu);
+    placement.worker_groups.push_back(group);
+    placement.group_cpus[group].push_back(cpu);
+  }
+
+  return placement;
+}
+
+std::string describePlacement(ThreadPlacement const &placement) {
+  std::ostringstream text;
+  text << placement.threadCount() << " render threads";
+
+  if (placement.worker_cpus.empty() || placement.worker_cpus[0] < 0) {
+    text << ", not pinned";
+    return text.str();
+  }
+
+  text << " pinned to CPUs";
+  for (unsigned int g = 0; g < placement.groupCount(); g++) {
+    text << (g > 0 ? "," : "") << " " << formatCpuList(placement.group_cpus[g])
+         << " (node " << placement.group_nodes[g] << ")";
+  }
+  if (!placement.ui_cpus.empty()) {
+    text << "; UI thread on CPUs " << formatCpuList(placement.ui_cpus);
+  }
+  return text.str();
+}
+
+bool pinThread(std::vector<unsigned int> const &cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned int cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return !cpus.empty() &&
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+void firstTouchRows(void *data, size_t row_bytes,
+                    std::vector<unsigned int> const &band_starts,
+                    ThreadPlacement const &placement) {
+#ifdef __linux__
+  if (placement.groupCount() < 2 || data == nullptr) {
+    return;
+  }
+
+  // Only whole pages that belong to the buffer alone can be released
+  size_t page = sysconf(_SC_PAGESIZE);
+  char *begin = static_cast<char *>(data);
+  char *end = begin + row_bytes * band_starts.back();
+  char *first_page = begin + (page - (size_t)begin % page) % page;
+  char *last_page = end - (size_t)end % page;
+  if (first_page >= last_page) {
+    return;
+  }
+  // Released pages read back as zeros, and are allocated again by whichever
+  // thread touches them next
+  madvise(first_page, last_page - first_page, MADV_DONTNEED);
+
+  std::vector<std::thread> touchers;
+  for (unsigned int g = 0; g < placement.groupCount(); g++) {
+    char *band_begin = std::max(first_page, begin + row_bytes * band_starts[g]);
+    char *band_end =
+        std::min(last_page, begin + row_bytes * band_starts[g + 1]);
+    touchers.emplace_back([&placement, g, band_begin, band_end, page] {
+      pinThread(placement.group_cpus[g]);
+      for (char volatile *p = band_begin; p < band_end; p += page) {
+        *p = 0;
+      }
+    });
+  }
+  for (std::thread &toucher : touchers) {
+    toucher.join();
+  }
+#endif
+}
@@ -0,0 +1,93 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/** A logical CPU as the kernel numbers them, and where it sits */
+struct Cpu {
+  unsigned int id;
+  unsigned int node;    /* NUMA node */
+  unsigned int package; /* socket */
+  unsigned int core;    /* physical core, shared by SMT siblings */
+};
+
+/** The CPUs this process may run on */
+struct CpuTopology {
+  std::vector<Cpu> cpus;
+};
+
+/** Read the CPUs, cores and NUMA nodes from sysfs (under root, normally
+ * /sys/devices/system), keeping only those the process's affinity mask
+ * allows. Where sysfs can't be read, every hardware thread is taken to be
+ * its own core on node 0.
+ */
+CpuTopology readTopology(std::string const &root = "/sys/devices/system");
+
+/** Parse a kernel CPU list such as "0-3,8,10-11". Throws
+ * std::invalid_argument if it doesn't parse.
+ */
+std::vector<unsigned int> parseCpuList(std::string const &text);
+std::string formatCpuList(std::vector<unsigned int> cpus);
+
+/** How --concurrency asks for render threads to be placed */
+struct AffinitySpec {
+  unsigned int threads{0};        /* 0 for one per CPU (left) */
+  bool pin{false};                /* pin each thread to a CPU */
+  std::vector<unsigned int> cpus; /* CPUs to use, empty for all */
+  unsigned int reserve{0};        /* cores kept for the UI thread */
+};
+
+/** Parse a thread count, or a colon-separated list of a thread count,
+ * "pin", "cpus=<list>" and "reserve=<cores>" (such as "16:reserve=1" or
+ * "cpus=0-7,16-23"). Giving CPUs or reserving cores implies pinning.
+ * Throws std::invalid_argument if it doesn't parse.
+ */
+AffinitySpec parseAffinitySpec(std::string const &text);
+
+/** Where each render thread runs. Threads are grouped by NUMA node; each
+ * group takes the tiles of its own band of rows, whose pages it touches
+ * first so that they are allocated on its node.
+ */
+struct ThreadPlacement {
+  std::vector<int> worker_cpus;            /* -1 where not pinned */
+  std::vector<unsigned int> worker_groups; /* group of each thread */
+  /* CPUs of each group's threads, and the node it is on */
+  std::vector<std::vector<unsigned int>> group_cpus;
+  std::vector<unsigned int> group_nodes;
+  std::vector<unsigned int> ui_cpus; /* for the UI thread, if reserved */
+
+  unsigned int threadCount() const { return worker_cpus.size(); }
+  unsigned int groupCount() const { return group_cpus.size(); }
+
+  // threads that aren't pinned, all in one group
+  static ThreadPlacement unpinned(unsigned int threads);
+};
+
+/** Place the threads of spec on the CPUs of topology: reserved cores come
+ * from the first node, and threads go round the nodes in turn, each taking
+ * a core of its own before any core gets a second thread. Throws
+ * std::invalid_argument if spec names CPUs that can't be used or reserves
+ * every core.
+ */
+ThreadPlacement planPlacement(CpuTopology const &topology,
+                              AffinitySpec const &spec);
+
+/** A line describing where the threads run, for the console */
+std::string describePlacement(ThreadPlacement const &placement);
+
+/** Pin the calling thread to cpus; returns false if that isn't supported */
+bool pinThread(std::vector<unsigned int> const &cpus);
+
+/** Hand the pages of a freshly allocated (all zero) buffer of rows to the
+ * NUMA nodes of placement: the pages are released, and each group's band of
+ * rows, from band_starts[g] to band_starts[g + 1], is first touched by a
+ * thread on that group's CPUs so the kernel allocates it on their node.
+ * Only does anything on Linux, with more than one group.
+ */
+void firstTouchRows(void *data, size_t row_bytes,
+                    std::vector<unsigned int> const &band_starts,
+                    ThreadPlacement const &placement);
+
+#endif
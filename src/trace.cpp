@@ -0,0 +1,129 @@
+#include "trace.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* Events kept per thread (about 2.5 MB each) */
+constexpr unsigned long long RING_CAPACITY = 1 << 16;
+
+std::atomic<bool> Trace::on{false};
+
+namespace {
+
+struct TraceEvent {
+  char const *name;
+  long long start_ns;
+  long long end_ns;
+  char const *arg_name;
+  unsigned long long arg;
+};
+
+/** One thread's events. Only the owning thread writes to it; count is
+ * published with release ordering so that write() sees whole events.
+ */
+struct ThreadBuffer {
+  unsigned int id;
+  std::string name;
+  std::vector<TraceEvent> events{RING_CAPACITY};
+  std::atomic<unsigned long long> count{0};
+};
+
+std::chrono::steady_clock::time_point trace_start;
+
+// Buffers outlive their threads, so that write() can still read them
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+thread_local ThreadBuffer *local_buffer = nullptr;
+
+ThreadBuffer &localBuffer() {
+  if (local_buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers.push_back(std::make_unique<ThreadBuffer>());
+    local_buffer = buffers.back().get();
+    local_buffer->id = buffers.size();
+    local_buffer->name = "thread " + std::to_string(local_buffer->id);
+  }
+  return *local_buffer;
+}
+
+/** Escapes a string for a JSON string literal */
+std::string jsonString(std::string const &text) {
+  std::string result = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+} // namespace
+
+void Trace::enable() {
+  trace_start = std::chrono::steady_clock::now();
+  on = true;
+  setThreadName("main");
+}
+
+long long Trace::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - trace_start)
+      .count();
+}
+
+void Trace::record(char const *name, long long start_ns, long long end_ns,
+                   char const *arg_name, unsigned long long arg) {
+  ThreadBuffer &buffer = localBuffer();
+  unsigned long long n = buffer.count.load(std::memory_order_relaxed);
+  buffer.events[n % RING_CAPACITY] =
+      TraceEvent{name, start_ns, end_ns, arg_name, arg};
+  buffer.count.store(n + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(std::string const &name) {
+  ThreadBuffer &buffer = localBuffer();
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  buffer.name = name;
+}
+
+bool Trace::write(std::string const &path) {
+  std::ofstream out(path);
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+
+  // Complete ("X") events with microsecond timestamps, one track per thread.
+  // Fixed notation keeps them to the nanosecond however long the trace runs.
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+  bool first = true;
+  for (auto const &buffer : buffers) {
+    out << (first ? "" : ",\n")
+        << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, "
+        << "\"tid\": " << buffer->id
+        << ", \"args\": {\"name\": " << jsonString(buffer->name) << "}}";
+    first = false;
+
+    unsigned long long count = buffer->count.load(std::memory_order_acquire);
+    unsigned long long oldest =
+        count > RING_CAPACITY ? count - RING_CAPACITY : 0;
+    for (unsigned long long n = oldest; n < count; n++) {
+      TraceEvent const &event = buffer->events[n % RING_CAPACITY];
+      out << ",\n{\"ph\": \"X\", \"name\": " << jsonString(event.name)
+          << ", \"pid\": 1, \"tid\": " << buffer->id
+          << ", \"ts\": " << event.start_ns / 1000.0
+          << ", \"dur\": " << (event.end_ns - event.start_ns) / 1000.0;
+      if (event.arg_name) {
+        out << ", \"args\": {" << jsonString(event.arg_name) << ": "
+            << event.arg << "}";
+      }
+      out << "}";
+    }
+  }
+  out << std::endl << "]}" << std::endl;
+
+  return (bool)out;
+}
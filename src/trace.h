@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <string>
+
+/**
+ * Timing of the render pipeline, written out as Chrome trace events (for
+ * chrome://tracing or ui.perfetto.dev).
+ *
+ * Every thread records into its own fixed-size ring buffer, so recording
+ * takes no locks; once a buffer is full its oldest events are overwritten.
+ * Until enable() is called a TraceSpan costs a single relaxed load.
+ */
+class Trace {
+public:
+  // starts tracing; the calling thread is named "main"
+  static void enable();
+  static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+  // nanoseconds since tracing was enabled
+  static long long now();
+  // records a span [start_ns, end_ns) on the calling thread, optionally
+  // with one named number attached
+  static void record(char const *name, long long start_ns, long long end_ns,
+                     char const *arg_name = nullptr,
+                     unsigned long long arg = 0);
+  // names the calling thread in the trace
+  static void setThreadName(std::string const &name);
+
+  // writes every thread's buffer out as JSON; call once the traced work
+  // has stopped. Returns false if the file couldn't be written.
+  static bool write(std::string const &path);
+
+private:
+  static std::atomic<bool> on;
+};
+
+/** Records the time from its construction to its destruction as a span.
+ * The name (and argument name) must be string literals.
+ */
+class TraceSpan {
+public:
+  explicit TraceSpan(char const *name)
+      : name(name), start(Trace::enabled() ? Trace::now() : -1) {}
+  ~TraceSpan() {
+    if (start >= 0) {
+      Trace::record(name, start, Trace::now(), arg_name, arg);
+    }
+  }
+
+  TraceSpan(TraceSpan const &) = delete;
+  TraceSpan &operator=(TraceSpan const &) = delete;
+
+  void setArg(char const *new_arg_name, unsigned long long value) {
+    arg_name = new_arg_name;
+    arg = value;
+  }
+
+private:
+  char const *name;
+  long long start;
+  char const *arg_name{nullptr};
+  unsigned long long arg{0};
+};
+
+#endif